@@ -0,0 +1,707 @@
+/**
+* FSID benchmark
+*
+* Measures inserts, hit and miss checks, reverse lookups and release of a broker, and concurrent readers and writers with rwlock callbacks.
+* Build with fsid.c, for example: cc -O2 bench.c fsid.c -o bench -lpthread -lm
+*
+* Usage: bench [-k keys[,keys...]] [-e tree|table|all] [-d uniform|zipf|collide|all] [-t threads] [-w writers] [-s seconds]
+*   -k  Number of keys, 1000,100000,1000000 by default, up to 100000000.
+*   -e  Index engine, all by default.
+*   -d  Key distribution of lookups: uniform, Zipfian with exponent 0.99, or collide where a user hash puts keys into groups of 64 equal hashes.
+*   -t  Threads of the concurrent run, 4 by default, 0 to skip it.
+*   -w  Writers among the threads, 1 by default.
+*   -s  Duration of the concurrent run in seconds, 1 by default.
+*
+* Latency percentiles are taken over blocks of 16 operations to keep the clock out of the measurement.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fsid.h"
+
+#define BENCH_BLOCK_SIZE (16)
+#define BENCH_MAX_SIZES (16)
+#define BENCH_MAX_THREADS (64)
+#define BENCH_ZIPF_EXPONENT (0.99)
+#define BENCH_COLLIDE_GROUP (64)
+#define BENCH_MIN_EXTRA (1 << 20)
+
+#define BENCH_DIST_UNIFORM (0)
+#define BENCH_DIST_ZIPF (1)
+#define BENCH_DIST_COLLIDE (2)
+
+static const char* benchDistNames[] = { "uniform", "zipf", "collide" };
+static const char* benchEngineNames[] = { "tree", "table" };
+
+/* Generated keys, stored back to back */
+typedef struct bench_keys_struct
+{
+    char*       buffer;
+    size_t*     offsets;
+    size_t      count;
+} bench_keys_t;
+
+/* Rejection-inversion Zipf sampler over ranks 1..N */
+typedef struct bench_zipf_struct
+{
+    double      exponent;
+    double      integralX1;
+    double      integralN;
+    double      s;
+    size_t      count;
+} bench_zipf_t;
+
+/* Latency samples of one measured phase */
+typedef struct bench_samples_struct
+{
+    double*     blocks;
+    size_t      count;
+    size_t      capacity;
+} bench_samples_t;
+
+/* Concurrent run state shared by threads */
+typedef struct bench_shared_struct
+{
+    fsid_t              fsid;
+    const bench_keys_t* keys;
+    const bench_keys_t* extra;
+    const bench_zipf_t* zipf;
+    int                 dist;
+    volatile int        stop;
+    size_t              nextExtra;
+    pthread_mutex_t     extraLock;
+} bench_shared_t;
+
+typedef struct bench_thread_struct
+{
+    bench_shared_t*     shared;
+    pthread_t           thread;
+    int                 writer;
+    uint64_t            seed;
+    size_t              ops;
+    bench_samples_t     samples;
+} bench_thread_t;
+
+static pthread_rwlock_t benchLock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void FSID_CALLBACK bench_rolock(void* _userData)
+{
+    pthread_rwlock_rdlock((pthread_rwlock_t*)_userData);
+}
+
+static void FSID_CALLBACK bench_rwlock(void* _userData)
+{
+    pthread_rwlock_wrlock((pthread_rwlock_t*)_userData);
+}
+
+static void FSID_CALLBACK bench_unlock(void* _userData)
+{
+    pthread_rwlock_unlock((pthread_rwlock_t*)_userData);
+}
+
+/* Weak user hash of the first 8 bytes, keys of collide distribution share them in groups */
+static uint32_t FSID_CALLBACK bench_hash_prefix(void* _userData, const char* _string, size_t _length)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t index = 0; index < _length && index < 8; ++index)
+        hash = (hash ^ (unsigned char)_string[index]) * 16777619u;
+
+    return hash;
+}
+
+static double bench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static uint64_t bench_random(uint64_t* _state)
+{
+    uint64_t value = (*_state += 0x9e3779b97f4a7c15ull);
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+static double bench_uniform(uint64_t* _state)
+{
+    return (double)(bench_random(_state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double bench_zipf_h(const bench_zipf_t* _zipf, double _x)
+{
+    return exp(-_zipf->exponent * log(_x));
+}
+
+static double bench_zipf_integral(const bench_zipf_t* _zipf, double _x)
+{
+    return (exp((1.0 - _zipf->exponent) * log(_x)) - 1.0) / (1.0 - _zipf->exponent);
+}
+
+static double bench_zipf_inverse(const bench_zipf_t* _zipf, double _y)
+{
+    return exp(log1p(_y * (1.0 - _zipf->exponent)) / (1.0 - _zipf->exponent));
+}
+
+static void bench_zipf_init(bench_zipf_t* _zipf, size_t _count, double _exponent)
+{
+    _zipf->exponent = _exponent;
+    _zipf->count = _count;
+    _zipf->integralX1 = bench_zipf_integral(_zipf, 1.5) - 1.0;
+    _zipf->integralN = bench_zipf_integral(_zipf, (double)_count + 0.5);
+    _zipf->s = 2.0 - bench_zipf_inverse(_zipf, bench_zipf_integral(_zipf, 2.5) - bench_zipf_h(_zipf, 2.0));
+}
+
+/* Rank in 0..N-1, rank 0 is the most frequent */
+static size_t bench_zipf_sample(const bench_zipf_t* _zipf, uint64_t* _state)
+{
+    for (;;)
+    {
+        const double u = _zipf->integralN + bench_uniform(_state) * (_zipf->integralX1 - _zipf->integralN);
+        const double x = bench_zipf_inverse(_zipf, u);
+        double k = floor(x + 0.5);
+
+        if (k < 1.0)
+            k = 1.0;
+        else if (k > (double)_zipf->count)
+            k = (double)_zipf->count;
+
+        if (k - x <= _zipf->s || u >= bench_zipf_integral(_zipf, k + 0.5) - bench_zipf_h(_zipf, k))
+            return (size_t)k - 1;
+    }
+}
+
+/* Index of key to look up, hot Zipf ranks are scattered over the key set */
+static size_t bench_pick(const bench_zipf_t* _zipf, int _dist, size_t _count, uint64_t* _state)
+{
+    if (_dist == BENCH_DIST_ZIPF)
+        return (size_t)(((uint64_t)bench_zipf_sample(_zipf, _state) * 0x9e3779b97f4a7c15ull) % _count);
+
+    return (size_t)(bench_random(_state) % _count);
+}
+
+/* Generate _count distinct keys of 9 to 28 bytes numbered from _first, sets with different _set are disjoint */
+static int bench_keys_create(bench_keys_t* _keys, int _set, size_t _first, size_t _count, int _dist)
+{
+    size_t size = 0;
+
+    _keys->count = _count;
+    _keys->buffer = (char*)malloc(_count * 32);
+    _keys->offsets = (size_t*)malloc((_count + 1) * sizeof(size_t));
+
+    if (!_keys->buffer || !_keys->offsets)
+        return 0;
+
+    for (size_t index = 0; index < _count; ++index)
+    {
+        const uint64_t number = _first + index;
+        uint64_t state = number;
+        const uint64_t noise = bench_random(&state);
+        int length;
+
+        _keys->offsets[index] = size;
+
+        /* Colliding sets share the prefix groups, so misses and new keys hit the same hash chains */
+        if (_dist == BENCH_DIST_COLLIDE)
+            length = snprintf(_keys->buffer + size, 32, "%08llx:%d.%u", (unsigned long long)(index / BENCH_COLLIDE_GROUP), _set, (unsigned)(index % BENCH_COLLIDE_GROUP));
+        else
+            length = snprintf(_keys->buffer + size, 32, "%.*s_%llu", (int)(noise % 12) + 1, "key.metric.name", (unsigned long long)number);
+
+        size += (size_t)length;
+    }
+
+    _keys->offsets[_count] = size;
+    return 1;
+}
+
+static void bench_keys_destroy(bench_keys_t* _keys)
+{
+    free(_keys->buffer);
+    free(_keys->offsets);
+}
+
+static const char* bench_key(const bench_keys_t* _keys, size_t _index, size_t* _length)
+{
+    *_length = _keys->offsets[_index + 1] - _keys->offsets[_index];
+    return _keys->buffer + _keys->offsets[_index];
+}
+
+static void bench_samples_add(bench_samples_t* _samples, double _block)
+{
+    if (_samples->count == _samples->capacity)
+    {
+        const size_t capacity = _samples->capacity ? _samples->capacity * 2 : 4096;
+        double* blocks = (double*)realloc(_samples->blocks, capacity * sizeof(double));
+
+        if (!blocks)
+            return;
+
+        _samples->blocks = blocks;
+        _samples->capacity = capacity;
+    }
+
+    _samples->blocks[_samples->count++] = _block;
+}
+
+static int bench_compare(const void* _a, const void* _b)
+{
+    const double a = *(const double*)_a;
+    const double b = *(const double*)_b;
+    return a < b ? -1 : a > b;
+}
+
+/* Print ns/op and per-op percentiles of blocks */
+static void bench_report(const char* _name, bench_samples_t* _samples, double _total, size_t _ops)
+{
+    if (!_ops || !_samples->count)
+        return;
+
+    qsort(_samples->blocks, _samples->count, sizeof(double), bench_compare);
+
+    printf("  %-22s %9.1f ns/op  p50 %7.1f  p90 %7.1f  p99 %7.1f  p99.9 %7.1f\n", _name, _total / (double)_ops,
+        _samples->blocks[_samples->count / 2] / BENCH_BLOCK_SIZE,
+        _samples->blocks[_samples->count * 9 / 10] / BENCH_BLOCK_SIZE,
+        _samples->blocks[_samples->count * 99 / 100] / BENCH_BLOCK_SIZE,
+        _samples->blocks[_samples->count * 999 / 1000] / BENCH_BLOCK_SIZE);
+
+    _samples->count = 0;
+}
+
+static fsid_t bench_create(int _engine, int _dist)
+{
+    fsid_init_t params;
+    fsid_t fsid = NULL;
+
+    memset(&params, 0, sizeof(params));
+    params.userData = &benchLock;
+    params.engine = _engine;
+    params.rolockFunc = &bench_rolock;
+    params.rounlockFunc = &bench_unlock;
+    params.rwlockFunc = &bench_rwlock;
+    params.rwunlockFunc = &bench_unlock;
+
+    if (_dist == BENCH_DIST_COLLIDE)
+        params.hashFunc = &bench_hash_prefix;
+
+    if (fsid_initialize(&fsid, &params) != FSID_SUCCESSFUL)
+        return NULL;
+
+    return fsid;
+}
+
+/* Single-threaded phases over one key set */
+static void bench_single(fsid_t _fsid, const bench_keys_t* _keys, const bench_keys_t* _misses, const bench_zipf_t* _zipf, int _dist, int* _values)
+{
+    const size_t count = _keys->count;
+    const size_t lookups = count < 1000000 ? 1000000 : count;
+    bench_samples_t samples = { NULL, 0, 0 };
+    uint64_t state = 12345;
+    volatile int sink = 0;
+    double start;
+    double total;
+
+    /* Inserts in key order */
+    total = 0;
+    for (size_t index = 0; index < count; index += BENCH_BLOCK_SIZE)
+    {
+        const size_t end = index + BENCH_BLOCK_SIZE < count ? index + BENCH_BLOCK_SIZE : count;
+
+        start = bench_now();
+        for (size_t key = index; key < end; ++key)
+        {
+            size_t length;
+            const char* string = bench_key(_keys, key, &length);
+            _values[key] = fsid_insert_stringlen(_fsid, string, length);
+        }
+        start = bench_now() - start;
+        total += start;
+        bench_samples_add(&samples, start * BENCH_BLOCK_SIZE / (double)(end - index));
+    }
+    bench_report("insert", &samples, total, count);
+
+#ifdef FSID_STATISTICS
+    {
+        fsid_statistics_t stat;
+
+        if (fsid_get_statistics(&stat, _fsid) == FSID_SUCCESSFUL && stat.valuesCount)
+            printf("  %-22s %9.1f bytes/key  (%zu keys, %zu bytes, %zu arena slack)\n", "memory",
+                (double)stat.memorySize / (double)stat.valuesCount, stat.valuesCount, stat.memorySize, stat.arenaSlack);
+    }
+#endif /* FSID_STATISTICS */
+
+    /* Checks of contained keys */
+    total = 0;
+    for (size_t index = 0; index < lookups; index += BENCH_BLOCK_SIZE)
+    {
+        size_t picks[BENCH_BLOCK_SIZE];
+
+        for (int block = 0; block < BENCH_BLOCK_SIZE; ++block)
+            picks[block] = bench_pick(_zipf, _dist, count, &state);
+
+        start = bench_now();
+        for (int block = 0; block < BENCH_BLOCK_SIZE; ++block)
+        {
+            size_t length;
+            const char* string = bench_key(_keys, picks[block], &length);
+            sink ^= fsid_check_stringlen(_fsid, string, length);
+        }
+        start = bench_now() - start;
+        total += start;
+        bench_samples_add(&samples, start);
+    }
+    bench_report("check hit", &samples, total, lookups);
+
+    /* Checks of keys never inserted */
+    total = 0;
+    for (size_t index = 0; index < lookups; index += BENCH_BLOCK_SIZE)
+    {
+        size_t picks[BENCH_BLOCK_SIZE];
+
+        for (int block = 0; block < BENCH_BLOCK_SIZE; ++block)
+            picks[block] = bench_pick(_zipf, _dist, _misses->count, &state);
+
+        start = bench_now();
+        for (int block = 0; block < BENCH_BLOCK_SIZE; ++block)
+        {
+            size_t length;
+            const char* string = bench_key(_misses, picks[block], &length);
+            sink ^= fsid_check_stringlen(_fsid, string, length);
+        }
+        start = bench_now() - start;
+        total += start;
+        bench_samples_add(&samples, start);
+    }
+    bench_report("check miss", &samples, total, lookups);
+
+    /* Reverse lookups of contained values */
+    total = 0;
+    for (size_t index = 0; index < lookups; index += BENCH_BLOCK_SIZE)
+    {
+        int picks[BENCH_BLOCK_SIZE];
+
+        for (int block = 0; block < BENCH_BLOCK_SIZE; ++block)
+            picks[block] = _values[bench_pick(_zipf, _dist, count, &state)];
+
+        start = bench_now();
+        for (int block = 0; block < BENCH_BLOCK_SIZE; ++block)
+        {
+            const char* string = NULL;
+            size_t length = 0;
+            sink ^= fsid_check_value(_fsid, picks[block], &string, &length);
+        }
+        start = bench_now() - start;
+        total += start;
+        bench_samples_add(&samples, start);
+    }
+    bench_report("check value", &samples, total, lookups);
+
+    free(samples.blocks);
+    (void)sink;
+}
+
+static void* bench_thread(void* _userData)
+{
+    bench_thread_t* thread = (bench_thread_t*)_userData;
+    bench_shared_t* shared = thread->shared;
+    volatile int sink = 0;
+
+    while (!shared->stop)
+    {
+        double start;
+
+        if (thread->writer)
+        {
+            size_t first;
+
+            pthread_mutex_lock(&shared->extraLock);
+            first = shared->nextExtra;
+            shared->nextExtra = first + BENCH_BLOCK_SIZE;
+            pthread_mutex_unlock(&shared->extraLock);
+
+            /* Writers stop inserting when the extra keys run out and idle until the run ends */
+            if (first + BENCH_BLOCK_SIZE > shared->extra->count)
+            {
+                struct timespec pause = { 0, 1000000 };
+                nanosleep(&pause, NULL);
+                continue;
+            }
+
+            start = bench_now();
+            for (size_t key = first; key < first + BENCH_BLOCK_SIZE; ++key)
+            {
+                size_t length;
+                const char* string = bench_key(shared->extra, key, &length);
+                sink ^= fsid_insert_stringlen(shared->fsid, string, length);
+            }
+        }
+        else
+        {
+            size_t picks[BENCH_BLOCK_SIZE];
+
+            for (int block = 0; block < BENCH_BLOCK_SIZE; ++block)
+                picks[block] = bench_pick(shared->zipf, shared->dist, shared->keys->count, &thread->seed);
+
+            start = bench_now();
+            for (int block = 0; block < BENCH_BLOCK_SIZE; ++block)
+            {
+                size_t length;
+                const char* string = bench_key(shared->keys, picks[block], &length);
+                sink ^= fsid_check_stringlen(shared->fsid, string, length);
+            }
+        }
+
+        bench_samples_add(&thread->samples, bench_now() - start);
+        thread->ops += BENCH_BLOCK_SIZE;
+    }
+
+    (void)sink;
+    return NULL;
+}
+
+/* Readers and writers on one broker for a fixed time */
+static void bench_concurrent(fsid_t _fsid, const bench_keys_t* _keys, const bench_keys_t* _extra, const bench_zipf_t* _zipf, int _dist, int _threads, int _writers, double _seconds)
+{
+    bench_thread_t threads[BENCH_MAX_THREADS];
+    bench_shared_t shared;
+    struct timespec duration;
+    int started = 0;
+
+    memset(&shared, 0, sizeof(shared));
+    shared.fsid = _fsid;
+    shared.keys = _keys;
+    shared.extra = _extra;
+    shared.zipf = _zipf;
+    shared.dist = _dist;
+    pthread_mutex_init(&shared.extraLock, NULL);
+
+    for (int index = 0; index < _threads; ++index)
+    {
+        memset(&threads[index], 0, sizeof(threads[index]));
+        threads[index].shared = &shared;
+        threads[index].writer = index < _writers;
+        threads[index].seed = 1000 + (uint64_t)index;
+
+        if (pthread_create(&threads[index].thread, NULL, &bench_thread, &threads[index]) != 0)
+            break;
+
+        started++;
+    }
+
+    duration.tv_sec = (time_t)_seconds;
+    duration.tv_nsec = (long)((_seconds - (double)duration.tv_sec) * 1e9);
+    nanosleep(&duration, NULL);
+    shared.stop = 1;
+
+    for (int index = 0; index < started; ++index)
+        pthread_join(threads[index].thread, NULL);
+
+    for (int role = 1; role >= 0; --role)
+    {
+        bench_samples_t samples = { NULL, 0, 0 };
+        double total = 0;
+        size_t ops = 0;
+        int count = 0;
+        char name[64];
+
+        for (int index = 0; index < started; ++index)
+        {
+            if (threads[index].writer != role)
+                continue;
+
+            for (size_t block = 0; block < threads[index].samples.count; ++block)
+            {
+                total += threads[index].samples.blocks[block];
+                bench_samples_add(&samples, threads[index].samples.blocks[block]);
+            }
+
+            ops += threads[index].ops;
+            count++;
+        }
+
+        if (!count)
+            continue;
+
+        snprintf(name, sizeof(name), "%d %s%s", count, role ? "writer" : "reader", count > 1 ? "s" : "");
+        printf("  %-22s %9.2f Mops/s\n", name, (double)ops / _seconds / 1e6);
+        bench_report(role ? "  insert" : "  check hit", &samples, total, ops);
+        free(samples.blocks);
+    }
+
+    for (int index = 0; index < started; ++index)
+        free(threads[index].samples.blocks);
+
+    pthread_mutex_destroy(&shared.extraLock);
+}
+
+static void bench_run(size_t _count, int _engine, int _dist, int _threads, int _writers, double _seconds)
+{
+    bench_keys_t keys;
+    bench_keys_t misses;
+    bench_keys_t extra;
+    bench_zipf_t zipf;
+    int* values = (int*)malloc(_count * sizeof(int));
+    fsid_t fsid;
+    double start;
+
+    printf("\n%zu keys, %s engine, %s distribution\n", _count, benchEngineNames[_engine], benchDistNames[_dist]);
+
+    bench_zipf_init(&zipf, _count, BENCH_ZIPF_EXPONENT);
+
+    if (!values || !bench_keys_create(&keys, 0, 0, _count, _dist) || !bench_keys_create(&misses, 1, _count, _count, _dist) ||
+        !bench_keys_create(&extra, 2, _count * 2, _count < BENCH_MIN_EXTRA ? BENCH_MIN_EXTRA : _count, _dist))
+    {
+        printf("  not enough of free memory\n");
+        exit(1);
+    }
+
+    fsid = bench_create(_engine, _dist);
+
+    if (!fsid)
+    {
+        printf("  cannot initialize broker\n");
+        exit(1);
+    }
+
+    bench_single(fsid, &keys, &misses, &zipf, _dist, values);
+
+    start = bench_now();
+    fsid_release(fsid);
+    start = bench_now() - start;
+    printf("  %-22s %9.1f ns/key  (%.2f ms)\n", "release", start / (double)_count, start / 1e6);
+
+    if (_threads > 0)
+    {
+        fsid = bench_create(_engine, _dist);
+
+        for (size_t index = 0; fsid && index < _count; ++index)
+        {
+            size_t length;
+            const char* string = bench_key(&keys, index, &length);
+            fsid_insert_stringlen(fsid, string, length);
+        }
+
+        if (fsid)
+        {
+            bench_concurrent(fsid, &keys, &extra, &zipf, _dist, _threads, _writers, _seconds);
+            fsid_release(fsid);
+        }
+    }
+
+    bench_keys_destroy(&keys);
+    bench_keys_destroy(&misses);
+    bench_keys_destroy(&extra);
+    free(values);
+}
+
+static void bench_usage(void)
+{
+    printf("Usage: bench [-k keys[,keys...]] [-e tree|table|all] [-d uniform|zipf|collide|all] [-t threads] [-w writers] [-s seconds]\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t sizes[BENCH_MAX_SIZES] = { 1000, 100000, 1000000 };
+    int sizesCount = 3;
+    int engineFirst = FSID_ENGINE_TREE;
+    int engineLast = FSID_ENGINE_HASHTABLE;
+    int distFirst = BENCH_DIST_UNIFORM;
+    int distLast = BENCH_DIST_COLLIDE;
+    int threads = 4;
+    int writers = 1;
+    double seconds = 1.0;
+
+    for (int index = 1; index < argc; ++index)
+    {
+        const char* option = argv[index];
+        const char* value = index + 1 < argc ? argv[index + 1] : NULL;
+
+        if (!value || option[0] != '-' || !option[1] || option[2])
+            bench_usage();
+
+        index++;
+
+        switch (option[1])
+        {
+        case 'k':
+            sizesCount = 0;
+
+            for (const char* item = value; *item && sizesCount < BENCH_MAX_SIZES; )
+            {
+                char* end;
+                sizes[sizesCount] = (size_t)strtoull(item, &end, 10);
+
+                if (end == item || sizes[sizesCount] == 0 || sizes[sizesCount] > 100000000)
+                    bench_usage();
+
+                sizesCount++;
+                item = *end == ',' ? end + 1 : end;
+            }
+            break;
+
+        case 'e':
+            if (!strcmp(value, "tree"))
+                engineFirst = engineLast = FSID_ENGINE_TREE;
+            else if (!strcmp(value, "table"))
+                engineFirst = engineLast = FSID_ENGINE_HASHTABLE;
+            else if (strcmp(value, "all"))
+                bench_usage();
+            break;
+
+        case 'd':
+            if (!strcmp(value, "all"))
+                break;
+
+            for (distFirst = BENCH_DIST_UNIFORM; distFirst <= BENCH_DIST_COLLIDE && strcmp(value, benchDistNames[distFirst]); ++distFirst)
+                ;
+
+            if (distFirst > BENCH_DIST_COLLIDE)
+                bench_usage();
+
+            distLast = distFirst;
+            break;
+
+        case 't':
+            threads = atoi(value);
+            if (threads < 0 || threads > BENCH_MAX_THREADS)
+                bench_usage();
+            break;
+
+        case 'w':
+            writers = atoi(value);
+            if (writers < 0)
+                bench_usage();
+            break;
+
+        case 's':
+            seconds = atof(value);
+            if (seconds <= 0)
+                bench_usage();
+            break;
+
+        default:
+            bench_usage();
+        }
+    }
+
+    printf("--= Fast string identifier benchmark =--\n");
+
+    for (int size = 0; size < sizesCount; ++size)
+    {
+        for (int engine = engineFirst; engine <= engineLast; ++engine)
+        {
+            for (int dist = distFirst; dist <= distLast; ++dist)
+                bench_run(sizes[size], engine, dist, threads, writers, seconds);
+        }
+    }
+
+    return 0;
+}
@@ -6,21 +6,196 @@
  * Licensed under the MIT license.
  */
 
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+/* Transparent huge page advice of madvise is declared only with the default feature set */
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE 1
+#endif
+
 #include "fsid.h"
 
+/* The default feature set of glibc declares its own fsid_t, it is renamed while system headers are included */
+#define fsid_t fsid_system_t
+
 #include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdio.h>
+
+#if defined(FSID_NO_SIMD)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FSID_SSE2 1
+#include <xmmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FSID_AVX2 1
+#endif
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && !defined(__ARM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define FSID_NEON 1
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define FSID_MMAP_WIN32 1
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <unistd.h>
+#define FSID_MMAP_POSIX 1
+#endif
+
+#undef fsid_t
+
+#if defined(FSID_MMAP_WIN32) || defined(FSID_MMAP_POSIX)
+#define FSID_HUGE_PAGES 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FSID_PREFETCH(_pointer) __builtin_prefetch(_pointer)
+#elif defined(FSID_SSE2)
+#define FSID_PREFETCH(_pointer) _mm_prefetch((const char*)(_pointer), _MM_HINT_T0)
+#else
+#define FSID_PREFETCH(_pointer) ((void)(_pointer))
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FSID_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define FSID_NOINLINE __declspec(noinline)
+#else
+#define FSID_NOINLINE
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FSID_ATOMICS 1
+#define FSID_LOAD_RELAXED(_pointer) __atomic_load_n(_pointer, __ATOMIC_RELAXED)
+#define FSID_LOAD_ACQUIRE(_pointer) __atomic_load_n(_pointer, __ATOMIC_ACQUIRE)
+#define FSID_STORE_RELAXED(_pointer, _value) __atomic_store_n(_pointer, _value, __ATOMIC_RELAXED)
+#define FSID_STORE_RELEASE(_pointer, _value) __atomic_store_n(_pointer, _value, __ATOMIC_RELEASE)
+#define FSID_FETCH_ADD(_pointer, _value) __atomic_fetch_add(_pointer, _value, __ATOMIC_RELAXED)
+#define FSID_EXCHANGE(_pointer, _value) __atomic_exchange_n(_pointer, _value, __ATOMIC_ACQUIRE)
+#define FSID_LOAD_SEQ_CST(_pointer) __atomic_load_n(_pointer, __ATOMIC_SEQ_CST)
+#define FSID_FETCH_ADD_SEQ_CST(_pointer, _value) __atomic_fetch_add(_pointer, _value, __ATOMIC_SEQ_CST)
+#define FSID_EXCHANGE_SEQ_CST(_pointer, _value) __atomic_exchange_n(_pointer, _value, __ATOMIC_SEQ_CST)
+#define FSID_COMPARE_EXCHANGE(_pointer, _expected, _value) __atomic_compare_exchange_n(_pointer, _expected, _value, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define FSID_FENCE_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define FSID_FENCE_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#define FSID_LOAD_RELAXED(_pointer) (*(_pointer))
+#define FSID_LOAD_ACQUIRE(_pointer) (*(_pointer))
+#define FSID_STORE_RELAXED(_pointer, _value) (*(_pointer) = (_value))
+#define FSID_STORE_RELEASE(_pointer, _value) (*(_pointer) = (_value))
+#define FSID_FETCH_ADD(_pointer, _value) ((*(_pointer) += (_value)) - (_value))
+#define FSID_EXCHANGE(_pointer, _value) (*(_pointer) = (_value), 0)
+#define FSID_LOAD_SEQ_CST(_pointer) (*(_pointer))
+#define FSID_FETCH_ADD_SEQ_CST(_pointer, _value) ((*(_pointer) += (_value)) - (_value))
+#define FSID_EXCHANGE_SEQ_CST(_pointer, _value) (*(_pointer) = (_value), 0)
+#define FSID_COMPARE_EXCHANGE(_pointer, _expected, _value) (*(_pointer) == *(_expected) ? (*(_pointer) = (_value), true) : (*(_expected) = *(_pointer), false))
+#define FSID_FENCE_ACQUIRE() ((void)0)
+#define FSID_FENCE_RELEASE() ((void)0)
+#endif
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define FSID_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__) || defined(__clang__)
+#define FSID_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define FSID_THREAD_LOCAL __declspec(thread)
+#endif
+
+/* Counters live in per-thread state of broker */
+#if defined(FSID_INSTRUMENTATION) && defined(FSID_THREAD_LOCAL) && defined(FSID_ATOMICS)
+#define FSID_INSTRUMENTED 1
+#define FSID_PROBE_STEP() (fsidProbeSteps++)
+#else
+#define FSID_PROBE_STEP() ((void)0)
+#endif
+
+#if defined(FSID_INSTRUMENTED) && !defined(_WIN32)
+#include <time.h>
+#endif
 
 #define FSID_EMPTY_STRING_VALUE (0)
 
 #define FSID_NODE_MAX_LEVEL (sizeof(int) * 8 * 145 / 100 + 1)
 #define FSID_NODE_POOL_CAPACITY (16)
-#define FSID_NODE_HASH_MASK (0xffffffc0)
+#define FSID_NODE_POOL_MAX_CAPACITY (64 * 1024)
+#define FSID_NODE_HASH_MASK (~(uint64_t)0x3f)
 #define FSID_NODE_HEIGHT_MASK (0x3f)
+#define FSID_NODE_KEYS_COUNT (4)
+#define FSID_NODE_KEY_MAX_LENGTH (0x3ffffff)
+#define FSID_VALUE_TABLE_CAPACITY (64)
+#define FSID_VALUE_SHORT ((uintptr_t)1)
+#define FSID_ARENA_CHUNK_SIZE (64 * 1024)
+#define FSID_HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+#define FSID_ARENA_ALIGNMENT (sizeof(void*))
+#define FSID_FREE_CLASSES (32)
+#define FSID_FREE_ARRAY_CAPACITY (64)
+#define FSID_GENERATION_BITS (8)
+#define FSID_GENERATION_MASK ((1 << FSID_GENERATION_BITS) - 1)
+#define FSID_EVICTION_SLACK (32)
+#define FSID_BATCH_SORT_THRESHOLD (16)
+#define FSID_BATCH_RADIX_THRESHOLD (256)
+#define FSID_BATCH_GROUP_SIZE (16)
+#define FSID_MERGE_BATCH_SIZE (4096)
+#define FSID_SHARD_MAX_BITS (8)
+#define FSID_SHARD_HASH_FACTOR (0x9e3779b97f4a7c15ull)
+#define FSID_THREAD_SLOTS (4)
+#define FSID_THREAD_CACHE_MAX_SIZE (1 << 20)
+#define FSID_SAMPLE_INTERVAL (1024)
+#define FSID_HASH_SEED (0xa0761d6478bd642full)
+#define FSID_HASH_SECRET0 (0xe7037ed1a0b428dbull)
+#define FSID_HASH_SECRET1 (0x8ebc6af09c88c6e3ull)
+#define FSID_HASH_SECRET2 (0x589965cc75374cc3ull)
+#define FSID_HASH_PRIME32 (0x9e3779b1u)
+#define FSID_HASH_PRIME64 (0x9e3779b97f4a7c15ull)
+#define FSID_HASH_STRIPE_SIZE (64)
+#define FSID_HASH_BLOCK_STRIPES (16)
+#define FSID_HASH_LONG_LENGTH (256)
+#define FSID_IMAGE_MAGIC (0x44495346)
+#define FSID_IMAGE_VERSION (1)
+#define FSID_IMAGE_HEADER_SIZE (40)
+#define FSID_IMAGE_BUFFER_SIZE (4096)
+#define FSID_IMAGE_PROBE "fsid"
+#define FSID_IMAGE_SECTION_IDS (0)
+#define FSID_IMAGE_SECTION_LENGTHS (1)
+#define FSID_IMAGE_SECTION_HASHES (2)
+#define FSID_IMAGE_SECTION_STRINGS (3)
+#define FSID_FROZEN_MAGIC (0x4d495346)
+#define FSID_FROZEN_VERSION (2)
+#define FSID_FROZEN_HEADER_SIZE (64)
+#define FSID_FROZEN_ENTRY_SIZE (24)
+#define FSID_FROZEN_BUCKET_KEYS (4)
+#define FSID_FROZEN_DENSE_THRESHOLD (0x9999999a)
+#define FSID_FROZEN_MAX_PILOT (0xffff)
+#define FSID_FROZEN_MAX_SEEDS (16)
+#define FSID_FROZEN_MAX_BUCKET (255)
+#define FSID_SPLIT_MAX_DELIMITERS (8)
+#define FSID_SPLIT_STACK_FIELDS (64)
+#define FSID_TABLE_GROUP_WIDTH (16)
+#define FSID_TABLE_TAG_MASK (0x7f)
+#define FSID_TABLE_TAG_BITS (7)
+#define FSID_TABLE_CTRL_EMPTY (0x80)
+#define FSID_TABLE_CTRL_DELETED (0x81)
+#define FSID_TABLE_CTRL_BUSY (0x82)
+#define FSID_TABLE_KEY_SIZE (FSID_INLINE_KEY_LENGTH > sizeof(void*) ? FSID_INLINE_KEY_LENGTH : sizeof(void*))
 
 /* Empty string with compiler-time check */
-static const char emptyString[FSID_NODE_MAX_LEVEL > FSID_NODE_HEIGHT_MASK ? 0 : 1] = { 0 };
+static const char emptyString[FSID_NODE_MAX_LEVEL > FSID_NODE_HEIGHT_MASK || FSID_INLINE_KEY_LENGTH > 255 ? 0 : 1] = { 0 };
 
 /*
  * Internal struct
@@ -30,52 +205,316 @@ static const char emptyString[FSID_NODE_MAX_LEVEL > FSID_NODE_HEIGHT_MASK ? 0 :
 typedef struct fsid_record_struct
 {
     struct fsid_record_struct* next;
+    const char* data;
     size_t length;
+    uint64_t hash;
     int value;
-    char data[1];
+    char buffer[1];
 } *fsid_record_t;
 
+/* Short string of hash table engine, value table refers to it by pointer tagged with FSID_VALUE_SHORT */
+typedef struct fsid_short_struct
+{
+    uint64_t hash;
+    uint8_t length;
+    char data[1];
+} *fsid_short_t;
+
+/* Free block of removed string, reused by strings of the same size */
+typedef struct fsid_free_block_struct
+{
+    struct fsid_free_block_struct* next;
+} *fsid_free_block_t;
+
+/* Block of removed string and value of bounded broker waiting until lock-free readers leave the epoch it was removed in */
+typedef struct fsid_limbo_struct
+{
+    void* block;
+    size_t size;
+    uint64_t epoch;
+    int value;
+} *fsid_limbo_t;
+
+/* String arena chunk */
+typedef struct fsid_arena_struct
+{
+    struct fsid_arena_struct* next;
+    size_t size;
+    size_t used;
+    char* data;
+} *fsid_arena_t;
+
 /* Binary tree node */
 typedef struct fsid_node_struct
 {
     struct fsid_node_struct* left;
     struct fsid_node_struct* right;
     struct fsid_record_struct* record;
-    uint32_t flags;
+    uint64_t flags;
+    uint32_t keys[FSID_NODE_KEYS_COUNT];
 } *fsid_node_t;
 
-/* Binary tree node pool */
+/* Binary tree node pool, pools grow geometrically up to FSID_NODE_POOL_MAX_CAPACITY nodes */
 typedef struct fsid_node_pool_struct
 {
     struct fsid_node_pool_struct* next;
-    struct fsid_node_struct nodes[FSID_NODE_POOL_CAPACITY];
+    size_t capacity;
     size_t count;
+    struct fsid_node_struct nodes[1];
 } *fsid_node_pool_t;
 
+/* Slot of hash table, strings up to FSID_INLINE_KEY_LENGTH bytes are kept inline padded with zeros, others by record pointer in key */
+typedef struct fsid_slot_struct
+{
+    char key[FSID_TABLE_KEY_SIZE];
+    uint8_t length;
+    int value;
+} *fsid_slot_t;
+
+/* Open-addressing hash table, slots are grouped by FSID_TABLE_GROUP_WIDTH control bytes */
+typedef struct fsid_table_struct
+{
+    struct fsid_table_struct* retired;
+    uint64_t epoch;
+    size_t capacity;
+    size_t count;
+    size_t growthLeft;
+#ifdef FSID_STATISTICS
+    size_t maxProbe;
+    size_t probeHistogram[FSID_STATISTICS_CHAIN_BUCKETS];
+#endif
+    uint8_t* ctrl;
+    struct fsid_slot_struct slots[1];
+} *fsid_table_t;
+
+/* Value table to lookup record by value, bounded brokers keep generation and reference bytes of values after the records */
+typedef struct fsid_value_table_struct
+{
+    struct fsid_value_table_struct* retired;
+    size_t capacity;
+    uint8_t* generations;
+    uint8_t* referenced;
+    struct fsid_record_struct* records[1];
+} *fsid_value_table_t;
+
+/* Entry of per-thread lookup cache */
+typedef struct fsid_cache_entry_struct
+{
+    struct fsid_record_struct* record;
+    uint32_t hash;
+    int value;
+} *fsid_cache_entry_t;
+
+/* Per-thread state of broker */
+typedef struct fsid_thread_struct
+{
+    struct fsid_thread_struct* next;
+    const void* owner;
+    size_t cacheMask;
+    size_t cacheHits;
+    size_t cacheMisses;
+    uint64_t epoch;
+    uint64_t cacheEpoch;
+#ifdef FSID_INSTRUMENTED
+    uint64_t checks;
+    uint64_t checkMisses;
+    uint64_t inserts;
+    uint64_t probeSteps;
+    uint64_t samples;
+    uint64_t sampleNanoseconds;
+    uint64_t lockNanoseconds;
+    uint32_t sampleCountdown;
+#endif
+    struct fsid_cache_entry_struct cache[1];
+} *fsid_thread_t;
+
+/* Thread-local reference to per-thread state of broker */
+typedef struct fsid_thread_slot_struct
+{
+    uint64_t serial;
+    struct fsid_thread_struct* thread;
+} *fsid_thread_slot_t;
+
+/* Batch entry */
+typedef struct fsid_batch_struct
+{
+    uint32_t key;
+    uint64_t hash;
+    size_t index;
+    const char* string;
+    size_t length;
+} *fsid_batch_t;
+
+/* Range of sorted nodes waiting for its place in breadth-first layout of compacted tree */
+typedef struct fsid_compact_range_struct
+{
+    size_t begin;
+    size_t end;
+    struct fsid_node_struct** link;
+} *fsid_compact_range_t;
+
+/* Delimiter set of split, vector scanning is used up to FSID_SPLIT_MAX_DELIMITERS distinct bytes */
+typedef struct fsid_split_struct
+{
+    uint8_t table[256];
+    uint8_t delimiters[FSID_SPLIT_MAX_DELIMITERS];
+    int count;
+} *fsid_split_t;
+
+/* Buffered writer of snapshot image */
+typedef struct fsid_writer_struct
+{
+    fsid_write writeFunc;
+    void* userData;
+    size_t used;
+    bool failed;
+    uint8_t buffer[FSID_IMAGE_BUFFER_SIZE];
+} *fsid_writer_t;
+
+/* Frozen image of replica written into memory of the replica broker */
+typedef struct fsid_image_writer_struct
+{
+    fsid_t fsid;
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} *fsid_image_writer_t;
+
+/* Read-only image with minimal perfect hash, all fields point into the image */
+typedef struct fsid_frozen_struct
+{
+    const uint8_t* pilots;
+    const uint8_t* entries;
+    const uint8_t* remap;
+    const uint8_t* values;
+    const char* strings;
+    uint64_t count;
+    uint64_t tableSize;
+    uint64_t bucketsCount;
+    uint64_t valuesCount;
+    uint64_t blobSize;
+    uint32_t generationBits;
+    uint32_t generationShift;
+    void* mapping;
+    size_t mappingSize;
+    uint8_t* image;
+    size_t imageSize;
+    uint64_t sourceSerial;
+    uint64_t sourceVersion;
+} *fsid_frozen_t;
+
+/* Key of minimal perfect hash construction */
+typedef struct fsid_frozen_key_struct
+{
+    uint64_t hash;
+    fsid_record_t record;
+    int value;
+    uint32_t position;
+} *fsid_frozen_key_t;
+
+/* State of minimal perfect hash construction */
+typedef struct fsid_frozen_build_struct
+{
+    fsid_frozen_key_t keys;
+    size_t count;
+    uint64_t tableSize;
+    uint64_t bucketsCount;
+    uint16_t* pilots;
+    uint32_t* offsets;
+    uint32_t* order;
+    uint32_t* buckets;
+    uint64_t* taken;
+} *fsid_frozen_build_t;
+
 /* FSID */
 struct fsid_struct
 {
     void*           userData;
+    void*           lockUserData;
     int             nextValue;
+    int             maxValue;
+    int             writersStopped;
+    uint32_t        sequence;
+    uint32_t        generationBits;
+    uint32_t        flags;
+    uint32_t        shardBits;
+    uint32_t        shardIndex;
+    fsid_t*         shards;
+    fsid_t          parent;
+    uint64_t        serial;
+    uint64_t        version;
+    size_t          threadCacheSize;
+    fsid_thread_t   threads;
+    int             threadsLock;
+    uint64_t        epoch;
+    size_t          epochReaders;
+    fsid_sample     sampleFunc;
+    uint32_t        sampleInterval;
 
     fsid_alloc      allocFunc;
     fsid_free       freeFunc;
     fsid_hash       hashFunc;
+    fsid_hash64     hash64Func;
+    uint64_t        hashSeed;
     fsid_rolock     rolockFunc;
     fsid_rounlock   rounlockFunc;
     fsid_rwlock     rwlockFunc;
     fsid_rwunlock   rwunlockFunc;
 
-    fsid_node_t      root;
-    fsid_node_pool_t pool;
+    int                 engine;
+    fsid_node_t         root;
+    fsid_node_pool_t    pool;
+    fsid_table_t        table;
+    fsid_value_table_t  values;
+    fsid_frozen_t       frozen;
+    fsid_arena_t        arena;
+    fsid_arena_t        retiredArena;
+    size_t              arenaChunkSize;
+    size_t              arenaAlignment;
+    fsid_node_t         freeNodes;
+    fsid_free_block_t   freeBlocks[FSID_FREE_CLASSES];
+    int*                freeValues;
+    size_t              freeValuesCount;
+    size_t              freeValuesCapacity;
+    fsid_limbo_t        limbo;
+    size_t              limboCount;
+    size_t              limboCapacity;
+    size_t              maxEntries;
+    size_t              maxBytes;
+    size_t              liveCount;
+    size_t              liveBytes;
+    int                 clockHand;
 
 #ifdef FSID_STATISTICS
     size_t          nodesCount;
     size_t          recordsCount;
     size_t          memorySize;
+    size_t          arenaSize;
+    size_t          arenaUsed;
+    size_t          freeBytes;
+    size_t          nodesCapacity;
+    size_t          stringBytes;
+    size_t          stringsStored;
+    size_t          allocCount;
+    size_t          evictions;
+    size_t          hugePagesDenied;
+    size_t          chainHistogram[FSID_STATISTICS_CHAIN_BUCKETS];
 #endif
 };
 
+/* Source of broker serials, serials are never reused so stale thread slots never match */
+static uint64_t fsidSerial = 0;
+
+#ifdef FSID_THREAD_LOCAL
+/* Per-thread state of recently used brokers, the array address also identifies the thread */
+static FSID_THREAD_LOCAL struct fsid_thread_slot_struct fsidThreadSlots[FSID_THREAD_SLOTS];
+#endif /* FSID_THREAD_LOCAL */
+
+#ifdef FSID_INSTRUMENTED
+/* Probe steps of the running operation, moved to per-thread state of broker when it completes */
+static FSID_THREAD_LOCAL uint64_t fsidProbeSteps;
+#endif /* FSID_INSTRUMENTED */
+
 /*
  * Default callbacks
  */
@@ -100,606 +539,5987 @@ static void FSID_CALLBACK fsid_unlock_default(void* _userData)
 {
 }
 
-/* Default hash */
-static uint32_t FSID_CALLBACK fsid_hash_default(void* _userData, const char* _string, size_t _length)
+/* Write snapshot image to file */
+static size_t FSID_CALLBACK fsid_write_file(void* _userData, const void* _data, size_t _size)
+{
+    return fwrite(_data, 1, _size, (FILE*)_userData);
+}
+
+/* Read snapshot image from file */
+static size_t FSID_CALLBACK fsid_read_file(void* _userData, void* _data, size_t _size)
+{
+    return fread(_data, 1, _size, (FILE*)_userData);
+}
+
+/* Keys of default hash for long strings */
+static const uint64_t fsidHashKeys[FSID_HASH_BLOCK_STRIPES + 8] =
+{
+    0xf6e7a35b88d4e310ull, 0x2e065d233f603a14ull, 0x17f087fafa1ba022ull, 0x8debc1cf0e0987dcull,
+    0x97f37c7ea217c8f6ull, 0x1467bd1df68dea34ull, 0x0b851b49fb3c711cull, 0x5a9d5433b4c6eed3ull,
+    0xa8364dc0f29f670dull, 0xdfb71767541e2c78ull, 0x71cdba19c44164b6ull, 0x417d1cb0ca2bce18ull,
+    0x71e31fa70381d16bull, 0xc399646039322d11ull, 0x91be2f1c419cf9c1ull, 0xa54ab0cd509d8161ull,
+    0x9d6a784ab423be97ull, 0xfbfa44d120dea3a0ull, 0x719ebe085e963db3ull, 0x339911855320da16ull,
+    0x58307598710f20e1ull, 0x737a423797de22d4ull, 0xc66ba8642dc53364ull, 0x1ad98e74e46135e2ull,
+};
+
+/* Little-endian unaligned 64-bit read */
+static inline uint64_t fsid_read64(const uint8_t* _data)
+{
+    uint64_t value;
+    memcpy(&value, _data, sizeof(value));
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+/* Little-endian unaligned 32-bit read */
+static inline uint64_t fsid_read32(const uint8_t* _data)
+{
+    uint32_t value;
+    memcpy(&value, _data, sizeof(value));
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+/* Little-endian unaligned 16-bit read */
+static inline uint32_t fsid_read16(const uint8_t* _data)
+{
+    return (uint32_t)_data[0] | ((uint32_t)_data[1] << 8);
+}
+
+/* Full 128-bit product of _a and _b, low half to _a and high half to _b */
+static inline void fsid_mum(uint64_t* _a, uint64_t* _b)
 {
-    const uint32_t m = 0x5bd1e995;
-    const int r = 24;
-    uint32_t h = 0xcc9e2d51 ^ (_length & 0xffffffff);
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = (unsigned __int128)*_a * *_b;
+    *_a = (uint64_t)product;
+    *_b = (uint64_t)(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    *_a = _umul128(*_a, *_b, _b);
+#else
+    const uint64_t ha = *_a >> 32, hb = *_b >> 32, la = (uint32_t)*_a, lb = (uint32_t)*_b;
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t = rl + (rm0 << 32);
+    const uint64_t low = t + (rm1 << 32);
+    *_b = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (low < t);
+    *_a = low;
+#endif
+}
+
+/* Fold 128-bit product */
+static inline uint64_t fsid_mix(uint64_t _a, uint64_t _b)
+{
+    fsid_mum(&_a, &_b);
+    return _a ^ _b;
+}
+
+/* Accumulate 64-byte stripes, every code path produces the same accumulators */
+static void fsid_hash_accumulate(uint64_t* _acc, const uint8_t* _data, size_t _stripes, const uint64_t* _keys)
+{
+#if defined(FSID_AVX2)
+    __m256i acc0 = _mm256_loadu_si256((const __m256i*)_acc);
+    __m256i acc1 = _mm256_loadu_si256((const __m256i*)(_acc + 4));
+
+    for (size_t stripe = 0; stripe < _stripes; ++stripe)
+    {
+        const uint8_t* data = _data + stripe * FSID_HASH_STRIPE_SIZE;
+        const __m256i data0 = _mm256_loadu_si256((const __m256i*)data);
+        const __m256i data1 = _mm256_loadu_si256((const __m256i*)(data + 32));
+        const __m256i key0 = _mm256_xor_si256(data0, _mm256_loadu_si256((const __m256i*)(_keys + stripe)));
+        const __m256i key1 = _mm256_xor_si256(data1, _mm256_loadu_si256((const __m256i*)(_keys + stripe + 4)));
+
+        acc0 = _mm256_add_epi64(acc0, _mm256_add_epi64(_mm256_mul_epu32(key0, _mm256_srli_epi64(key0, 32)), _mm256_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2))));
+        acc1 = _mm256_add_epi64(acc1, _mm256_add_epi64(_mm256_mul_epu32(key1, _mm256_srli_epi64(key1, 32)), _mm256_shuffle_epi32(data1, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+
+    _mm256_storeu_si256((__m256i*)_acc, acc0);
+    _mm256_storeu_si256((__m256i*)(_acc + 4), acc1);
+#elif defined(FSID_SSE2)
+    __m128i acc[4];
+
+    for (int lane = 0; lane < 4; ++lane)
+        acc[lane] = _mm_loadu_si128((const __m128i*)(_acc + lane * 2));
+
+    for (size_t stripe = 0; stripe < _stripes; ++stripe)
+    {
+        const uint8_t* data = _data + stripe * FSID_HASH_STRIPE_SIZE;
+
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            const __m128i value = _mm_loadu_si128((const __m128i*)(data + lane * 16));
+            const __m128i key = _mm_xor_si128(value, _mm_loadu_si128((const __m128i*)(_keys + stripe + lane * 2)));
 
-    while (_length >= 4)
+            acc[lane] = _mm_add_epi64(acc[lane], _mm_add_epi64(_mm_mul_epu32(key, _mm_srli_epi64(key, 32)), _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2))));
+        }
+    }
+
+    for (int lane = 0; lane < 4; ++lane)
+        _mm_storeu_si128((__m128i*)(_acc + lane * 2), acc[lane]);
+#elif defined(FSID_NEON)
+    uint64x2_t acc[4];
+
+    for (int lane = 0; lane < 4; ++lane)
+        acc[lane] = vld1q_u64(_acc + lane * 2);
+
+    for (size_t stripe = 0; stripe < _stripes; ++stripe)
+    {
+        const uint8_t* data = _data + stripe * FSID_HASH_STRIPE_SIZE;
+
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            const uint64x2_t value = vreinterpretq_u64_u8(vld1q_u8(data + lane * 16));
+            const uint64x2_t key = veorq_u64(value, vld1q_u64(_keys + stripe + lane * 2));
+
+            acc[lane] = vaddq_u64(acc[lane], vaddq_u64(vmull_u32(vmovn_u64(key), vshrn_n_u64(key, 32)), vextq_u64(value, value, 1)));
+        }
+    }
+
+    for (int lane = 0; lane < 4; ++lane)
+        vst1q_u64(_acc + lane * 2, acc[lane]);
+#else
+    for (size_t stripe = 0; stripe < _stripes; ++stripe)
     {
-        uint32_t k = *(uint32_t*)_string;
+        const uint8_t* data = _data + stripe * FSID_HASH_STRIPE_SIZE;
 
-        k *= m;
-        k ^= k >> r;
-        k *= m;
+        for (int lane = 0; lane < 8; ++lane)
+        {
+            const uint64_t value = fsid_read64(data + lane * 8);
+            const uint64_t key = value ^ _keys[stripe + lane];
+
+            _acc[lane ^ 1] += value;
+            _acc[lane] += (key & 0xffffffff) * (key >> 32);
+        }
+    }
+#endif
+}
 
-        h *= m;
-        h ^= k;
+/* Scramble accumulators after block of stripes */
+static inline void fsid_hash_scramble(uint64_t* _acc, const uint64_t* _keys)
+{
+    for (int lane = 0; lane < 8; ++lane)
+    {
+        uint64_t acc = _acc[lane];
 
-        _string += 4;
-        _length -= 4;
+        acc ^= acc >> 47;
+        acc ^= _keys[lane];
+        acc *= FSID_HASH_PRIME32;
+        _acc[lane] = acc;
     }
+}
 
-    switch (_length)
+/* Hash of long string, processes 64 bytes per iteration */
+static uint64_t fsid_hash_long(const uint8_t* _data, size_t _length)
+{
+    uint64_t acc[8] =
     {
-    case 3: h ^= _string[2] << 16;
-    case 2: h ^= _string[1] << 8;
-    case 1: h ^= _string[0];
-        h *= m;
+        0xc2b2ae3dull, 0x9e3779b185ebca87ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull,
+        0x85ebca77c2b2ae63ull, 0x85ebca77ull, 0x27d4eb2f165667c5ull, 0x9e3779b1ull
     };
+    const size_t blockSize = FSID_HASH_STRIPE_SIZE * FSID_HASH_BLOCK_STRIPES;
+    const size_t blocks = (_length - 1) / blockSize;
+
+    for (size_t block = 0; block < blocks; ++block)
+    {
+        fsid_hash_accumulate(acc, _data + block * blockSize, FSID_HASH_BLOCK_STRIPES, fsidHashKeys);
+        fsid_hash_scramble(acc, fsidHashKeys + FSID_HASH_BLOCK_STRIPES);
+    }
+
+    fsid_hash_accumulate(acc, _data + blocks * blockSize, (_length - 1 - blocks * blockSize) / FSID_HASH_STRIPE_SIZE, fsidHashKeys);
+    fsid_hash_accumulate(acc, _data + _length - FSID_HASH_STRIPE_SIZE, 1, fsidHashKeys + 9);
+
+    uint64_t result = _length * FSID_HASH_PRIME64;
+
+    for (int lane = 0; lane < 8; lane += 2)
+        result += fsid_mix(acc[lane] ^ fsidHashKeys[lane + 11], acc[lane + 1] ^ fsidHashKeys[lane + 12]);
+
+    result ^= result >> 37;
+    result *= 0x165667919e3779f9ull;
+    result ^= result >> 32;
+    return result;
+}
+
+/* Default hash, wyhash-like for short and medium strings and vectorized accumulation for long strings, fsid::hash in fsid.hpp mirrors strings below FSID_HASH_LONG_LENGTH */
+static uint64_t fsid_hash_seeded(const char* _string, size_t _length, uint64_t _seed)
+{
+    const uint8_t* data = (const uint8_t*)_string;
+    uint64_t seed = _seed;
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    if (_length <= 16)
+    {
+        if (_length >= 4)
+        {
+            const size_t offset = (_length >> 3) << 2;
+
+            a = (fsid_read32(data) << 32) | fsid_read32(data + offset);
+            b = (fsid_read32(data + _length - 4) << 32) | fsid_read32(data + _length - 4 - offset);
+        }
+        else if (_length > 0)
+        {
+            a = ((uint64_t)data[0] << 16) | ((uint64_t)data[_length >> 1] << 8) | data[_length - 1];
+        }
+    }
+    else if (_length < FSID_HASH_LONG_LENGTH)
+    {
+        uint64_t seed1 = seed;
+        size_t left = _length;
+
+        /* Two independent lanes of 16 bytes */
+        while (left > 32)
+        {
+            seed = fsid_mix(fsid_read64(data) ^ FSID_HASH_SECRET0, fsid_read64(data + 8) ^ seed);
+            seed1 = fsid_mix(fsid_read64(data + 16) ^ FSID_HASH_SECRET1, fsid_read64(data + 24) ^ seed1);
+            data += 32;
+            left -= 32;
+        }
+
+        seed ^= seed1;
 
-    h ^= h >> 13;
-    h *= m;
-    h ^= h >> 15;
+        if (left > 16)
+            seed = fsid_mix(fsid_read64(data) ^ FSID_HASH_SECRET0, fsid_read64(data + 8) ^ seed);
+
+        a = fsid_read64(data + left - 16);
+        b = fsid_read64(data + left - 8);
+    }
+    else
+    {
+        seed ^= fsid_hash_long(data, _length);
+        a = fsid_read64(data + _length - 16);
+        b = fsid_read64(data + _length - 8);
+    }
 
-    return h;
+    a ^= FSID_HASH_SECRET0;
+    b ^= seed;
+    fsid_mum(&a, &b);
+    return fsid_mix(a ^ FSID_HASH_SECRET2 ^ _length, b ^ FSID_HASH_SECRET0);
 }
 
 /*
  * Internal functions
  */
 
-/* Allocate memory block */
+#ifdef FSID_HUGE_PAGES
+/* Allocate block of whole huge pages, normal pages are taken and _huge is cleared if the system has no huge pages available */
+static void* fsid_huge_alloc(size_t _size, bool* _huge)
+{
+#if defined(FSID_MMAP_WIN32)
+    const SIZE_T largePage = GetLargePageMinimum();
+    void* pointer = NULL;
+
+    /* Large pages need the lock pages in memory privilege */
+    if (largePage && _size % largePage == 0)
+        pointer = VirtualAlloc(NULL, _size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+    *_huge = pointer != NULL;
+
+    if (!pointer)
+        pointer = VirtualAlloc(NULL, _size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    return pointer;
+#else
+    void* pointer = NULL;
+
+    *_huge = false;
+
+    if (posix_memalign(&pointer, FSID_HUGE_PAGE_SIZE, _size) != 0)
+        return NULL;
+
+    /* Kernel backs aligned block by transparent huge pages, it may refuse if they are disabled */
+#ifdef MADV_HUGEPAGE
+    *_huge = madvise(pointer, _size, MADV_HUGEPAGE) == 0;
+#endif /* MADV_HUGEPAGE */
+
+    return pointer;
+#endif
+}
+
+/* Free block of huge pages */
+static void fsid_huge_free(void* _pointer)
+{
+#if defined(FSID_MMAP_WIN32)
+    VirtualFree(_pointer, 0, MEM_RELEASE);
+#else
+    free(_pointer);
+#endif
+}
+#else
+static void* fsid_huge_alloc(size_t _size, bool* _huge)
+{
+    *_huge = false;
+    return NULL;
+}
+
+static void fsid_huge_free(void* _pointer)
+{
+}
+#endif /* FSID_HUGE_PAGES */
+
+/* Size of memory block rounded up to huge pages, 0 if the block is allocated by allocFunc */
+static inline size_t fsid_huge_size(const fsid_t _fsid, size_t _size)
+{
+    if (!(_fsid->flags & FSID_FLAG_HUGE_PAGES) || _size < FSID_HUGE_PAGE_SIZE)
+        return 0;
+
+    return (_size + FSID_HUGE_PAGE_SIZE - 1) & ~(FSID_HUGE_PAGE_SIZE - 1);
+}
+
+/* Allocate memory block, large blocks of broker with huge pages bypass allocFunc */
 static inline void* fsid_alloc_func(fsid_t _fsid, size_t _size)
 {
-    void* pointer = _fsid->allocFunc(_fsid->userData, _size);
+    /* Lock-free writers allocate concurrently */
+#ifdef FSID_STATISTICS
+    FSID_FETCH_ADD(&_fsid->allocCount, 1);
+#endif /* FSID_STATISTICS */
+
+    const size_t hugeSize = fsid_huge_size(_fsid, _size);
+    bool huge = false;
+    void* pointer = hugeSize ? fsid_huge_alloc(hugeSize, &huge) : _fsid->allocFunc(_fsid->userData, _size);
 
     if (!pointer)
         return NULL;
 
 #ifdef FSID_STATISTICS
-    _fsid->memorySize += _size;
+    FSID_FETCH_ADD(&_fsid->memorySize, hugeSize ? hugeSize : _size);
+
+    if (hugeSize && !huge)
+        FSID_FETCH_ADD(&_fsid->hugePagesDenied, 1);
 #endif /* FSID_STATISTICS */
     return pointer;
 }
 
-/* Free memory block */
+/* Free memory block of _size bytes passed to fsid_alloc_func */
 static inline void fsid_free_func(fsid_t _fsid, void* _pointer, size_t _size)
 {
+    const size_t hugeSize = fsid_huge_size(_fsid, _size);
+
 #ifdef FSID_STATISTICS
-    _fsid->memorySize -= _size;
+    FSID_FETCH_ADD(&_fsid->memorySize, (size_t)0 - (hugeSize ? hugeSize : _size));
 #endif /* FSID_STATISTICS */
 
-    _fsid->freeFunc(_fsid->userData, _pointer);
+    if (hugeSize)
+        fsid_huge_free(_pointer);
+    else
+        _fsid->freeFunc(_fsid->userData, _pointer);
 }
 
 /* Calculate string hash */
-static inline uint32_t fsid_hash_func(fsid_t _fsid, const char* _string, size_t _length)
+static inline uint64_t fsid_hash_func(fsid_t _fsid, const char* _string, size_t _length)
 {
-    return _fsid->hashFunc(_fsid->userData, _string, _length) & FSID_NODE_HASH_MASK;
+    if (_fsid->hash64Func)
+        return _fsid->hash64Func(_fsid->userData, _string, _length);
+
+    /* Spread 32-bit user hash over 64 bits, the multiplication is bijective */
+    if (_fsid->hashFunc)
+        return _fsid->hashFunc(_fsid->userData, _string, _length) * FSID_HASH_PRIME64;
+
+    return fsid_hash_seeded(_string, _length, _fsid->hashSeed);
 }
 
 /* Read-only lock */
 static inline void fsid_rolock_func(fsid_t _fsid)
 {
-    _fsid->rolockFunc(_fsid->userData);
+    if (!(_fsid->flags & (FSID_FLAG_LOCKFREE_READERS | FSID_FLAG_EXTERNAL_LOCKING)))
+        _fsid->rolockFunc(_fsid->lockUserData);
 }
 
 /* Read-only unlock */
 static inline void fsid_rounlock_func(fsid_t _fsid)
 {
-    _fsid->rounlockFunc(_fsid->userData);
+    if (!(_fsid->flags & (FSID_FLAG_LOCKFREE_READERS | FSID_FLAG_EXTERNAL_LOCKING)))
+        _fsid->rounlockFunc(_fsid->lockUserData);
 }
 
-/* Read-write lock */
+/* Read-write lock, sequence of broker with optimistic readers stays odd until unlock */
 static inline void fsid_rwlock_func(fsid_t _fsid)
 {
-    _fsid->rwlockFunc(_fsid->userData);
+    if (!(_fsid->flags & FSID_FLAG_EXTERNAL_LOCKING))
+        _fsid->rwlockFunc(_fsid->lockUserData);
+
+    if (_fsid->flags & FSID_FLAG_OPTIMISTIC_READERS)
+    {
+        FSID_STORE_RELAXED(&_fsid->sequence, _fsid->sequence + 1);
+        FSID_FENCE_RELEASE();
+    }
 }
 
 /* Read-write unlock */
 static inline void fsid_rwunlock_func(fsid_t _fsid)
 {
-    _fsid->rwunlockFunc(_fsid->userData);
+    if (_fsid->flags & FSID_FLAG_OPTIMISTIC_READERS)
+        FSID_STORE_RELEASE(&_fsid->sequence, _fsid->sequence + 1);
+
+    if (!(_fsid->flags & FSID_FLAG_EXTERNAL_LOCKING))
+        _fsid->rwunlockFunc(_fsid->lockUserData);
 }
 
-/* Create record */
-static fsid_record_t fsid_record_create(fsid_t _fsid, int _value, const char* _string, size_t _length)
+/* Allocate arena chunk with _size usable bytes */
+static fsid_arena_t fsid_arena_create(fsid_t _fsid, size_t _size)
 {
-    const size_t size = sizeof(struct fsid_record_struct) + _length;
-    fsid_record_t record = (fsid_record_t)fsid_alloc_func(_fsid, size);
+    const size_t size = sizeof(struct fsid_arena_struct) + _size + _fsid->arenaAlignment - 1;
+    fsid_arena_t arena = (fsid_arena_t)fsid_alloc_func(_fsid, size);
 
-    if (!record)
+    if (!arena)
         return NULL;
 
-    memcpy(record->data, _string, _length);
-    record->data[_length] = 0;
-    record->length = _length;
-    record->value = _value;
-    record->next = NULL;
+    const uintptr_t data = (uintptr_t)(arena + 1);
+
+    arena->data = (char*)((data + _fsid->arenaAlignment - 1) & ~(uintptr_t)(_fsid->arenaAlignment - 1));
+    arena->size = _size;
+    arena->used = 0;
 
 #ifdef FSID_STATISTICS
-    _fsid->recordsCount++;
+    FSID_FETCH_ADD(&_fsid->arenaSize, _size);
 #endif /* FSID_STATISTICS */
 
-    return record;
+    return arena;
 }
 
-/* Destroy record */
-static void fsid_record_destroy(fsid_t _fsid, fsid_record_t _record)
+/* Free arena chunk */
+static void fsid_arena_destroy(fsid_t _fsid, fsid_arena_t _arena)
 {
-    fsid_free_func(_fsid, _record, sizeof(struct fsid_record_struct) + _record->length);
-
 #ifdef FSID_STATISTICS
-    _fsid->recordsCount--;
+    FSID_FETCH_ADD(&_fsid->arenaSize, (size_t)0 - _arena->size);
+    FSID_FETCH_ADD(&_fsid->arenaUsed, (size_t)0 - _arena->used);
 #endif /* FSID_STATISTICS */
+
+    fsid_free_func(_fsid, _arena, sizeof(struct fsid_arena_struct) + _arena->size + _fsid->arenaAlignment - 1);
 }
 
-/* Create node of tree */
-static fsid_node_t fsid_node_create(fsid_t _fsid, uint32_t _hash)
+/* Free list of arena chunks */
+static void fsid_arena_destroy_all(fsid_t _fsid, fsid_arena_t _arena)
 {
-    fsid_node_pool_t pool = _fsid->pool;
+    while (_arena)
+    {
+        fsid_arena_t next = _arena->next;
+        fsid_arena_destroy(_fsid, _arena);
+        _arena = next;
+    }
+}
 
-    if (!pool || pool->count == FSID_NODE_POOL_CAPACITY)
+/* Keep list of arena chunks until release, lock-free readers may still use them */
+static void fsid_arena_retire(fsid_t _fsid, fsid_arena_t _arena)
+{
+    while (_arena)
     {
-        pool = (fsid_node_pool_t)fsid_alloc_func(_fsid, sizeof(struct fsid_node_pool_struct));
+        fsid_arena_t next = _arena->next;
+        _arena->next = _fsid->retiredArena;
+        _fsid->retiredArena = _arena;
+        _arena = next;
+    }
+}
 
-        if (!pool)
+/* Allocate aligned memory block from arena */
+static void* fsid_arena_alloc(fsid_t _fsid, size_t _size)
+{
+    const size_t alignment = _fsid->arenaAlignment;
+    const size_t size = (_size + alignment - 1) & ~(alignment - 1);
+    fsid_arena_t arena = _fsid->arena;
+
+    if (!arena || arena->size - arena->used < size)
+    {
+        if (size > _fsid->arenaChunkSize / 4)
+        {
+            /* Large block gets own chunk to keep the tail of the current chunk */
+            fsid_arena_t chunk = fsid_arena_create(_fsid, size);
+
+            if (!chunk)
+                return NULL;
+
+            if (arena)
+            {
+                chunk->next = arena->next;
+                arena->next = chunk;
+            }
+            else
+            {
+                chunk->next = NULL;
+                _fsid->arena = chunk;
+            }
+
+            chunk->used = size;
+
+#ifdef FSID_STATISTICS
+            _fsid->arenaUsed += size;
+#endif /* FSID_STATISTICS */
+
+            return chunk->data;
+        }
+
+        arena = fsid_arena_create(_fsid, _fsid->arenaChunkSize);
+
+        if (!arena)
             return NULL;
 
-        pool->count = 0;
-        pool->next = _fsid->pool;
-        _fsid->pool = pool;
+        arena->next = _fsid->arena;
+        _fsid->arena = arena;
     }
 
+    void* pointer = arena->data + arena->used;
+    arena->used += size;
+
 #ifdef FSID_STATISTICS
-    _fsid->nodesCount++;
+    _fsid->arenaUsed += size;
 #endif /* FSID_STATISTICS */
 
-    fsid_node_t node = &pool->nodes[pool->count++];
-
-    node->left = NULL;
-    node->right = NULL;
-    node->record = NULL;
-    node->flags = _hash;
-    return node;
+    return pointer;
 }
 
-static int fsid_node_height(const fsid_node_t _node)
+/* Allocate aligned memory block from arena shared by lock-free writers, blocks and chunks are taken by compare-exchange */
+static void* fsid_arena_alloc_shared(fsid_t _fsid, size_t _size)
 {
-    if (!_node)
-        return -1;
+    const size_t alignment = _fsid->arenaAlignment;
+    const size_t size = (_size + alignment - 1) & ~(alignment - 1);
 
-    return _node->flags & FSID_NODE_HEIGHT_MASK;
-}
+    for (;;)
+    {
+        fsid_arena_t arena = FSID_LOAD_ACQUIRE(&_fsid->arena);
+        size_t used = arena ? FSID_LOAD_RELAXED(&arena->used) : 0;
 
-static uint32_t fsid_node_hash(const fsid_node_t _node)
+        while (arena && arena->size - used >= size)
+        {
+            if (FSID_COMPARE_EXCHANGE(&arena->used, &used, used + size))
+            {
+#ifdef FSID_STATISTICS
+                FSID_FETCH_ADD(&_fsid->arenaUsed, size);
+#endif /* FSID_STATISTICS */
+
+                return arena->data + used;
+            }
+        }
+
+        const bool large = size > _fsid->arenaChunkSize / 4;
+        fsid_arena_t chunk = fsid_arena_create(_fsid, large ? size : _fsid->arenaChunkSize);
+
+        if (!chunk)
+            return NULL;
+
+        chunk->used = size;
+
+#ifdef FSID_STATISTICS
+        FSID_FETCH_ADD(&_fsid->arenaUsed, size);
+#endif /* FSID_STATISTICS */
+
+        /* Large block gets own chunk behind the current one to keep its tail */
+        if (large && arena)
+        {
+            fsid_arena_t next = FSID_LOAD_RELAXED(&arena->next);
+
+            do
+                chunk->next = next;
+            while (!FSID_COMPARE_EXCHANGE(&arena->next, &next, chunk));
+
+            return chunk->data;
+        }
+
+        chunk->next = arena;
+
+        if (FSID_COMPARE_EXCHANGE(&_fsid->arena, &arena, chunk))
+            return chunk->data;
+
+        /* Another writer has pushed a chunk meanwhile */
+        fsid_arena_destroy(_fsid, chunk);
+    }
+}
+
+/* Size of per-thread state with specific cache size */
+static inline size_t fsid_thread_size(size_t _cacheSize)
 {
-    if (!_node)
+    return sizeof(struct fsid_thread_struct) + sizeof(struct fsid_cache_entry_struct) * (_cacheSize ? _cacheSize - 1 : 0);
+}
+
+#ifdef FSID_THREAD_LOCAL
+/* Find or register per-thread state of broker for the calling thread, NULL if not enough of free memory, kept out of line for the lookup paths */
+static FSID_NOINLINE fsid_thread_t fsid_thread_register(fsid_t _fsid, fsid_thread_slot_t _slot)
+{
+    /* With external locking checks run concurrently under the caller's shared lock, and lock-free inserts under none, registration takes its own lock */
+    if (_fsid->flags & (FSID_FLAG_EXTERNAL_LOCKING | FSID_FLAG_LOCKFREE_WRITERS))
+    {
+        while (FSID_EXCHANGE(&_fsid->threadsLock, 1))
+            ;
+    }
+    else
+    {
+        fsid_rwlock_func(_fsid);
+    }
+
+    fsid_thread_t thread = _fsid->threads;
+
+    /* Thread may have been displaced from the slot by another broker */
+    while (thread && thread->owner != fsidThreadSlots)
+        thread = thread->next;
+
+    if (!thread)
+    {
+        thread = (fsid_thread_t)fsid_alloc_func(_fsid, fsid_thread_size(_fsid->threadCacheSize));
+
+        if (thread)
+        {
+            memset(thread, 0, fsid_thread_size(_fsid->threadCacheSize));
+            thread->owner = fsidThreadSlots;
+            thread->cacheMask = _fsid->threadCacheSize ? _fsid->threadCacheSize - 1 : 0;
+#ifdef FSID_INSTRUMENTED
+            thread->sampleCountdown = _fsid->sampleInterval;
+#endif /* FSID_INSTRUMENTED */
+            thread->next = _fsid->threads;
+            FSID_STORE_RELEASE(&_fsid->threads, thread);
+        }
+    }
+
+    if (_fsid->flags & (FSID_FLAG_EXTERNAL_LOCKING | FSID_FLAG_LOCKFREE_WRITERS))
+        FSID_STORE_RELEASE(&_fsid->threadsLock, 0);
+    else
+        fsid_rwunlock_func(_fsid);
+
+    if (thread)
+    {
+        _slot->serial = _fsid->serial;
+        _slot->thread = thread;
+    }
+    return thread;
+}
+
+/* Get per-thread state of broker for the calling thread, NULL if not enough of free memory */
+static inline fsid_thread_t fsid_thread_get(fsid_t _fsid)
+{
+    fsid_thread_slot_t slot = &fsidThreadSlots[_fsid->serial & (FSID_THREAD_SLOTS - 1)];
+
+    if (slot->serial == _fsid->serial)
+        return slot->thread;
+
+    return fsid_thread_register(_fsid, slot);
+}
+#endif /* FSID_THREAD_LOCAL */
+
+/* Short string of tagged value table entry, NULL for record */
+static inline fsid_short_t fsid_record_short(const fsid_record_t _record)
+{
+    return ((uintptr_t)_record & FSID_VALUE_SHORT) ? (fsid_short_t)((uintptr_t)_record & ~FSID_VALUE_SHORT) : NULL;
+}
+
+/* String of value table entry */
+static inline const char* fsid_record_data(const fsid_record_t _record)
+{
+    const fsid_short_t entry = fsid_record_short(_record);
+
+    return entry ? entry->data : _record->data;
+}
+
+/* String length of value table entry */
+static inline size_t fsid_record_length(const fsid_record_t _record)
+{
+    const fsid_short_t entry = fsid_record_short(_record);
+
+    return entry ? entry->length : _record->length;
+}
+
+/* String hash of value table entry */
+static inline uint64_t fsid_record_hash(const fsid_record_t _record)
+{
+    const fsid_short_t entry = fsid_record_short(_record);
+
+    return entry ? entry->hash : _record->hash;
+}
+
+/* Size of value table entry in arena */
+static size_t fsid_record_size(const fsid_t _fsid, const fsid_record_t _record)
+{
+    const size_t alignment = _fsid->arenaAlignment;
+    const fsid_short_t entry = fsid_record_short(_record);
+    size_t size = 0;
+
+    if (entry)
+        size = offsetof(struct fsid_short_struct, data) + entry->length + 1;
+    else
+        size = offsetof(struct fsid_record_struct, buffer) + (_record->data == _record->buffer ? _record->length + 1 : 0);
+
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/* Cache entry of string in per-thread cache */
+static inline fsid_cache_entry_t fsid_thread_entry(fsid_thread_t _thread, size_t _length, uint64_t _hash)
+{
+    return &_thread->cache[(size_t)(_hash ^ (uint64_t)_length * FSID_SHARD_HASH_FACTOR) & _thread->cacheMask];
+}
+
+/* Check string in per-thread cache */
+static inline int fsid_thread_check(fsid_thread_t _thread, const char* _string, size_t _length, uint64_t _hash)
+{
+    fsid_cache_entry_t entry = fsid_thread_entry(_thread, _length, _hash);
+    fsid_record_t record = entry->record;
+
+    if (record && entry->hash == (uint32_t)_hash && fsid_record_length(record) == _length && memcmp(fsid_record_data(record), _string, _length) == 0)
+    {
+        FSID_STORE_RELAXED(&_thread->cacheHits, _thread->cacheHits + 1);
+        return entry->value;
+    }
+
+    FSID_STORE_RELAXED(&_thread->cacheMisses, _thread->cacheMisses + 1);
+    return FSID_ERR_INVALID_VALUE;
+}
+
+/* Remember value of string in per-thread cache, the string may have been removed meanwhile by another thread */
+static inline void fsid_thread_store(fsid_thread_t _thread, fsid_record_t _record, int _value)
+{
+    if (!_record)
+        return;
+
+    const uint64_t hash = fsid_record_hash(_record);
+    fsid_cache_entry_t entry = fsid_thread_entry(_thread, fsid_record_length(_record), hash);
+
+    entry->record = _record;
+    entry->hash = (uint32_t)hash;
+    entry->value = _value;
+}
+
+/* Grow array of _itemSize bytes items to hold _count + 1 items, returns the array or NULL if not enough of free memory */
+static void* fsid_array_grow(fsid_t _fsid, void* _items, size_t _count, size_t* _capacity, size_t _itemSize)
+{
+    if (_count < *_capacity)
+        return _items;
+
+    const size_t capacity = *_capacity ? *_capacity * 2 : FSID_FREE_ARRAY_CAPACITY;
+    void* items = fsid_alloc_func(_fsid, capacity * _itemSize);
+
+    if (!items)
+        return NULL;
+
+    if (_items)
+    {
+        memcpy(items, _items, _count * _itemSize);
+        fsid_free_func(_fsid, _items, *_capacity * _itemSize);
+    }
+
+    *_capacity = capacity;
+    return items;
+}
+
+/* Broker keeping epoch and per-thread states, shards share them with the broker in front */
+static inline fsid_t fsid_epoch_owner(const fsid_t _fsid)
+{
+    return _fsid->parent ? _fsid->parent : _fsid;
+}
+
+/* Check if checks take no lock, memory replaced by writers is retired instead of freed */
+static inline bool fsid_readers_unlocked(const fsid_t _fsid)
+{
+    return (_fsid->flags & (FSID_FLAG_LOCKFREE_READERS | FSID_FLAG_OPTIMISTIC_READERS)) != 0;
+}
+
+/* Check if strings may be accessed without the broker lock, by readers without lock or per-thread caches */
+static inline bool fsid_epoch_used(const fsid_t _fsid)
+{
+    return fsid_readers_unlocked(_fsid) || fsid_epoch_owner(_fsid)->threadCacheSize;
+}
+
+/* Enter access without lock, memory removed meanwhile is not reused until the thread leaves */
+static inline void fsid_epoch_enter(fsid_t _fsid, fsid_thread_t _thread)
+{
+    /* Threads without own state are counted together */
+    if (!_thread)
+    {
+        FSID_FETCH_ADD_SEQ_CST(&_fsid->epochReaders, 1);
+        return;
+    }
+
+    const uint64_t epoch = FSID_LOAD_ACQUIRE(&_fsid->epoch);
+
+    FSID_EXCHANGE_SEQ_CST(&_thread->epoch, epoch);
+
+    /* Each removal starts an epoch, cached strings may have been removed since the cache was filled */
+    if (_thread->cacheEpoch != epoch)
+    {
+        for (size_t index = 0; index < _fsid->threadCacheSize; ++index)
+            _thread->cache[index].record = NULL;
+
+        _thread->cacheEpoch = epoch;
+    }
+}
+
+/* Leave access without lock */
+static inline void fsid_epoch_leave(fsid_t _fsid, fsid_thread_t _thread)
+{
+    if (!_thread)
+    {
+        FSID_FETCH_ADD_SEQ_CST(&_fsid->epochReaders, (size_t)-1);
+        return;
+    }
+
+    FSID_STORE_RELEASE(&_thread->epoch, 0);
+}
+
+/* Start the next epoch after memory was unlinked, returns the epoch the memory was retired in */
+static uint64_t fsid_epoch_advance(fsid_t _fsid)
+{
+    return FSID_FETCH_ADD_SEQ_CST(&fsid_epoch_owner(_fsid)->epoch, 1);
+}
+
+/* Oldest epoch readers without lock are still in, memory retired before it is not accessed anymore */
+static uint64_t fsid_epoch_oldest(const fsid_t _fsid)
+{
+    const fsid_t owner = fsid_epoch_owner(_fsid);
+    uint64_t oldest = UINT64_MAX;
+
+    if (FSID_LOAD_SEQ_CST(&owner->epochReaders))
         return 0;
 
-    return _node->flags & FSID_NODE_HASH_MASK;
+    for (fsid_thread_t thread = FSID_LOAD_ACQUIRE(&owner->threads); thread; thread = thread->next)
+    {
+        const uint64_t epoch = FSID_LOAD_SEQ_CST(&thread->epoch);
+
+        if (epoch && epoch < oldest)
+            oldest = epoch;
+    }
+    return oldest;
 }
 
-static int fsid_node_balance_factor(const fsid_node_t _node)
+/* Give up the processor while another thread finishes its step */
+static void fsid_yield(void)
 {
-    return fsid_node_height(_node->right) - fsid_node_height(_node->left);
+#if defined(_WIN32)
+    SwitchToThread();
+#elif defined(FSID_MMAP_POSIX)
+    sched_yield();
+#endif
 }
 
-static void fsid_node_fix_height(fsid_node_t _node)
+/* Sequence of broker before optimistic read, waits while a writer holds the lock */
+static inline uint32_t fsid_read_begin(const fsid_t _fsid)
 {
-    const int heightLeft = fsid_node_height(_node->left);
-    const int heightRight = fsid_node_height(_node->right);
+    uint32_t sequence;
+
+    while ((sequence = FSID_LOAD_ACQUIRE(&_fsid->sequence)) & 1)
+        fsid_yield();
 
-    _node->flags = fsid_node_hash(_node) | ((heightLeft > heightRight ? heightLeft : heightRight) + 1);
+    return sequence;
 }
 
-static fsid_node_t fsid_node_rotate_right(fsid_node_t _node)
+/* Check that no writer changed broker since fsid_read_begin, otherwise the read has to be repeated */
+static inline bool fsid_read_valid(const fsid_t _fsid, uint32_t _sequence)
 {
-    fsid_node_t other = _node->left;
-    _node->left = other->right;
-    other->right = _node;
+    FSID_FENCE_ACQUIRE();
+    return FSID_LOAD_RELAXED(&_fsid->sequence) == _sequence;
+}
 
-    fsid_node_fix_height(_node);
-    fsid_node_fix_height(other);
+/* Read-write lock of writers other than inserts, lock-free inserts are stopped and the ones in progress are waited for */
+static void fsid_exclusive_lock(fsid_t _fsid)
+{
+    fsid_rwlock_func(_fsid);
 
-    return other;
+    if (!(_fsid->flags & FSID_FLAG_LOCKFREE_WRITERS))
+        return;
+
+    /* Inserts check the flag after entering the epoch, each of them either sees it or is waited for */
+    FSID_EXCHANGE_SEQ_CST(&_fsid->writersStopped, 1);
+
+    const uint64_t epoch = fsid_epoch_advance(_fsid);
+
+    while (fsid_epoch_oldest(_fsid) <= epoch)
+        fsid_yield();
 }
 
-static fsid_node_t fsid_node_rotate_left(fsid_node_t _node)
+/* Read-write unlock of writers other than inserts */
+static void fsid_exclusive_unlock(fsid_t _fsid)
 {
-    fsid_node_t other = _node->right;
-    _node->right = other->left;
-    other->left = _node;
-    
-    fsid_node_fix_height(_node);
-    fsid_node_fix_height(other);
+    if (_fsid->flags & FSID_FLAG_LOCKFREE_WRITERS)
+        FSID_STORE_RELEASE(&_fsid->writersStopped, 0);
 
-    return other;
+    fsid_rwunlock_func(_fsid);
 }
 
-static fsid_node_t fsid_node_balance(fsid_node_t _node)
+/* Wait outside the epoch of _owner until lock-free inserts into _fsid are resumed */
+static void fsid_writers_wait(fsid_t _fsid, fsid_t _owner, fsid_thread_t _thread)
 {
-    fsid_node_fix_height(_node);
+    fsid_epoch_leave(_owner, _thread);
 
-    const int balance = fsid_node_balance_factor(_node);
+    /* Read-write lock is held until inserts are resumed, unless the lock callbacks do nothing */
+    fsid_rwlock_func(_fsid);
+    fsid_rwunlock_func(_fsid);
 
-    if (balance == 2)
+    if (FSID_LOAD_ACQUIRE(&_fsid->writersStopped))
+        fsid_yield();
+
+    fsid_epoch_enter(_owner, _thread);
+}
+
+/* Put block of removed string to free list of its size, blocks too large for the free lists stay unused until fsid_compact */
+static void fsid_block_free(fsid_t _fsid, void* _block, size_t _size)
+{
+    const size_t sizeClass = _size / _fsid->arenaAlignment;
+
+    if (sizeClass < FSID_FREE_CLASSES)
     {
-        if (fsid_node_balance_factor(_node->right) < 0)
-            _node->right = fsid_node_rotate_right(_node->right);
-        return fsid_node_rotate_left(_node);
+        fsid_free_block_t block = (fsid_free_block_t)_block;
+
+        block->next = _fsid->freeBlocks[sizeClass];
+        _fsid->freeBlocks[sizeClass] = block;
     }
-    else if (balance == -2)
+
+#ifdef FSID_STATISTICS
+    _fsid->freeBytes += _size;
+#endif /* FSID_STATISTICS */
+}
+
+/* Allocate block of string, blocks of removed strings of the same size are reused first */
+static void* fsid_block_alloc(fsid_t _fsid, size_t _size)
+{
+    const size_t alignment = _fsid->arenaAlignment;
+    const size_t size = (_size + alignment - 1) & ~(alignment - 1);
+    const size_t sizeClass = size / alignment;
+
+    /* Free lists are not shared by lock-free writers, blocks of removed strings stay unused until fsid_compact */
+    if (_fsid->flags & FSID_FLAG_LOCKFREE_WRITERS)
+        return fsid_arena_alloc_shared(_fsid, _size);
+
+    if (sizeClass < FSID_FREE_CLASSES && _fsid->freeBlocks[sizeClass])
     {
-        if (fsid_node_balance_factor(_node->left) > 0)
-            _node->left = fsid_node_rotate_left(_node->left);
-        return fsid_node_rotate_right(_node);
+        fsid_free_block_t block = _fsid->freeBlocks[sizeClass];
+
+        _fsid->freeBlocks[sizeClass] = block->next;
+
+#ifdef FSID_STATISTICS
+        _fsid->freeBytes -= size;
+#endif /* FSID_STATISTICS */
+
+        return block;
     }
 
-    return _node;
+    return fsid_arena_alloc(_fsid, _size);
 }
 
-/* Thread-safe methods */
+/* Create record */
+static fsid_record_t fsid_record_create(fsid_t _fsid, int _value, const char* _string, size_t _length, uint64_t _hash, bool _external)
+{
+    const size_t size = offsetof(struct fsid_record_struct, buffer) + (_external ? 0 : _length + 1);
+    fsid_record_t record = (fsid_record_t)fsid_block_alloc(_fsid, size);
+
+    if (!record)
+        return NULL;
+
+    /* External string is referenced in place, the caller keeps it alive */
+    if (_external)
+    {
+        record->data = _string;
+    }
+    else
+    {
+        memcpy(record->buffer, _string, _length);
+        record->buffer[_length] = 0;
+        record->data = record->buffer;
+    }
+
+    record->length = _length;
+    record->hash = _hash;
+    record->value = _value;
+    record->next = NULL;
+
+    FSID_FETCH_ADD(&_fsid->version, 1);
+
+#ifdef FSID_STATISTICS
+    FSID_FETCH_ADD(&_fsid->recordsCount, 1);
+    FSID_FETCH_ADD(&_fsid->stringBytes, _length);
+
+    if (!_external)
+        FSID_FETCH_ADD(&_fsid->stringsStored, _length + 1);
+#endif /* FSID_STATISTICS */
+
+    return record;
+}
 
-int fsid_check_stringlen_safe(const fsid_t _fsid, const char* _string, size_t _length, const uint32_t _hash)
+/* Create short string of hash table engine, returns tagged pointer stored in value table instead of record */
+static fsid_record_t fsid_short_create(fsid_t _fsid, const char* _string, size_t _length, uint64_t _hash)
 {
-    fsid_node_t node = _fsid->root;
+    fsid_short_t entry = (fsid_short_t)fsid_block_alloc(_fsid, offsetof(struct fsid_short_struct, data) + _length + 1);
 
-    while (node)
+    if (!entry)
+        return NULL;
+
+    entry->hash = _hash;
+    entry->length = (uint8_t)_length;
+    memcpy(entry->data, _string, _length);
+    entry->data[_length] = 0;
+
+    FSID_FETCH_ADD(&_fsid->version, 1);
+
+#ifdef FSID_STATISTICS
+    FSID_FETCH_ADD(&_fsid->recordsCount, 1);
+    FSID_FETCH_ADD(&_fsid->stringBytes, _length);
+    FSID_FETCH_ADD(&_fsid->stringsStored, _length + 1);
+#endif /* FSID_STATISTICS */
+
+    return (fsid_record_t)((uintptr_t)entry | FSID_VALUE_SHORT);
+}
+
+#ifdef FSID_STATISTICS
+/* Histogram bucket of chain length, lengths from 1 << bucket to (2 << bucket) - 1 */
+static inline size_t fsid_statistics_bucket(size_t _length)
+{
+    size_t bucket = 0;
+
+    while (_length > 1 && bucket < FSID_STATISTICS_CHAIN_BUCKETS - 1)
     {
-        if (_hash == fsid_node_hash(node))
-            break;
-        else if (_hash < fsid_node_hash(node))
-            node = node->left;
-        else
-            node = node->right;
+        _length >>= 1;
+        bucket++;
     }
+    return bucket;
+}
+#endif /* FSID_STATISTICS */
 
-    if (node)
+/* Size of node pool with specific capacity */
+static inline size_t fsid_node_pool_size(size_t _capacity)
+{
+    return sizeof(struct fsid_node_pool_struct) + sizeof(struct fsid_node_struct) * (_capacity - 1);
+}
+
+/* Create empty node pool and make it current */
+static fsid_node_pool_t fsid_node_pool_create(fsid_t _fsid, size_t _capacity)
+{
+    fsid_node_pool_t pool = (fsid_node_pool_t)fsid_alloc_func(_fsid, fsid_node_pool_size(_capacity));
+
+    if (!pool)
+        return NULL;
+
+    pool->capacity = _capacity;
+    pool->count = 0;
+    pool->next = _fsid->pool;
+    _fsid->pool = pool;
+
+#ifdef FSID_STATISTICS
+    _fsid->nodesCapacity += _capacity;
+#endif /* FSID_STATISTICS */
+
+    return pool;
+}
+
+/* Free list of node pools */
+static void fsid_node_pool_destroy_all(fsid_t _fsid, fsid_node_pool_t _pool)
+{
+    while (_pool)
     {
-        fsid_record_t record = node->record;
+        fsid_node_pool_t next = _pool->next;
+
+#ifdef FSID_STATISTICS
+        _fsid->nodesCapacity -= _pool->capacity;
+#endif /* FSID_STATISTICS */
+
+        fsid_free_func(_fsid, _pool, fsid_node_pool_size(_pool->capacity));
+        _pool = next;
+    }
+}
+
+/* Create node of tree, nodes of removed hashes are reused first */
+static fsid_node_t fsid_node_create(fsid_t _fsid, uint64_t _hash)
+{
+    fsid_node_pool_t pool = _fsid->pool;
+    fsid_node_t node = _fsid->freeNodes;
+
+    if (node)
+        _fsid->freeNodes = node->left;
+    else if (!pool || pool->count == pool->capacity)
+    {
+        size_t capacity = FSID_NODE_POOL_CAPACITY;
+
+        if (pool)
+            capacity = pool->capacity < FSID_NODE_POOL_MAX_CAPACITY / 2 ? pool->capacity * 2 : FSID_NODE_POOL_MAX_CAPACITY;
+
+        pool = fsid_node_pool_create(_fsid, capacity);
+
+        if (!pool)
+            return NULL;
+    }
+
+#ifdef FSID_STATISTICS
+    _fsid->nodesCount++;
+#endif /* FSID_STATISTICS */
+
+    if (!node)
+        node = &pool->nodes[pool->count++];
+
+    node->left = NULL;
+    node->right = NULL;
+    node->record = NULL;
+    node->flags = _hash & FSID_NODE_HASH_MASK;
+    memset(node->keys, 0, sizeof(node->keys));
+    return node;
+}
+
+static int fsid_node_height(const fsid_node_t _node)
+{
+    if (!_node)
+        return -1;
+
+    return _node->flags & FSID_NODE_HEIGHT_MASK;
+}
+
+static uint64_t fsid_node_hash(const fsid_node_t _node)
+{
+    if (!_node)
+        return 0;
+
+    return _node->flags & FSID_NODE_HASH_MASK;
+}
+
+static int fsid_node_balance_factor(const fsid_node_t _node)
+{
+    return fsid_node_height(_node->right) - fsid_node_height(_node->left);
+}
+
+static void fsid_node_fix_height(fsid_node_t _node)
+{
+    const int heightLeft = fsid_node_height(_node->left);
+    const int heightRight = fsid_node_height(_node->right);
+
+    _node->flags = fsid_node_hash(_node) | (uint64_t)((heightLeft > heightRight ? heightLeft : heightRight) + 1);
+}
+
+static fsid_node_t fsid_node_rotate_right(fsid_node_t _node)
+{
+    fsid_node_t other = _node->left;
+    _node->left = other->right;
+    other->right = _node;
+
+    fsid_node_fix_height(_node);
+    fsid_node_fix_height(other);
+
+    return other;
+}
+
+static fsid_node_t fsid_node_rotate_left(fsid_node_t _node)
+{
+    fsid_node_t other = _node->right;
+    _node->right = other->left;
+    other->left = _node;
+    
+    fsid_node_fix_height(_node);
+    fsid_node_fix_height(other);
+
+    return other;
+}
+
+static fsid_node_t fsid_node_balance(fsid_node_t _node)
+{
+    fsid_node_fix_height(_node);
+
+    const int balance = fsid_node_balance_factor(_node);
+
+    if (balance == 2)
+    {
+        if (fsid_node_balance_factor(_node->right) < 0)
+            _node->right = fsid_node_rotate_right(_node->right);
+        return fsid_node_rotate_left(_node);
+    }
+    else if (balance == -2)
+    {
+        if (fsid_node_balance_factor(_node->left) > 0)
+            _node->left = fsid_node_rotate_left(_node->left);
+        return fsid_node_rotate_right(_node);
+    }
+
+    return _node;
+}
+
+/* Size of value table with specific capacity */
+static inline size_t fsid_value_table_size(const fsid_t _fsid, size_t _capacity)
+{
+    return sizeof(struct fsid_value_table_struct) + sizeof(fsid_record_t) * (_capacity - 1) + (_fsid->generationBits ? _capacity * 2 : 0);
+}
+
+/* Grow value table to contain _value */
+static bool fsid_value_table_reserve(fsid_t _fsid, int _value)
+{
+    fsid_value_table_t values = _fsid->values;
+    const size_t oldCapacity = values ? values->capacity : 0;
+
+    if ((size_t)_value < oldCapacity)
+        return true;
+
+    size_t capacity = oldCapacity ? oldCapacity * 2 : FSID_VALUE_TABLE_CAPACITY;
+
+    while (capacity <= (size_t)_value)
+        capacity *= 2;
+
+    fsid_value_table_t table = (fsid_value_table_t)fsid_alloc_func(_fsid, fsid_value_table_size(_fsid, capacity));
+
+    if (!table)
+        return false;
+
+    table->retired = NULL;
+    table->capacity = capacity;
+    table->generations = NULL;
+    table->referenced = NULL;
+
+    if (oldCapacity)
+        memcpy(table->records, values->records, sizeof(fsid_record_t) * oldCapacity);
+
+    memset(table->records + oldCapacity, 0, sizeof(fsid_record_t) * (capacity - oldCapacity));
+
+    if (_fsid->generationBits)
+    {
+        table->generations = (uint8_t*)(table->records + capacity);
+        table->referenced = table->generations + capacity;
+
+        if (oldCapacity)
+            memcpy(table->generations, values->generations, oldCapacity);
+
+        /* Readers set reference bytes without lock */
+        for (size_t value = 0; value < oldCapacity; ++value)
+            table->referenced[value] = FSID_LOAD_RELAXED(&values->referenced[value]);
+
+        memset(table->generations + oldCapacity, 0, capacity - oldCapacity);
+        memset(table->referenced + oldCapacity, 0, capacity - oldCapacity);
+    }
+
+    /* Readers without lock may still use the old table, it is kept until release */
+    if (values && fsid_readers_unlocked(_fsid))
+        table->retired = values;
+    else if (values)
+        fsid_free_func(_fsid, values, fsid_value_table_size(_fsid, oldCapacity));
+
+    FSID_STORE_RELEASE(&_fsid->values, table);
+    return true;
+}
+
+/* Inline key of chain record, never zero for non-empty string */
+static inline uint32_t fsid_node_key(size_t _length, uint64_t _hash)
+{
+    const uint32_t length = _length < FSID_NODE_KEY_MAX_LENGTH ? (uint32_t)_length : FSID_NODE_KEY_MAX_LENGTH;
+
+    return (length << 6) | (uint32_t)(_hash & FSID_NODE_HEIGHT_MASK);
+}
+
+/* Bit mask of inline keys equal to _key */
+static inline uint32_t fsid_node_match(const fsid_node_t _node, uint32_t _key)
+{
+#if defined(FSID_SSE2)
+    const __m128i keys = _mm_loadu_si128((const __m128i*)_node->keys);
+
+    return (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(keys, _mm_set1_epi32((int)_key))));
+#elif defined(FSID_NEON)
+    static const uint32_t bits[FSID_NODE_KEYS_COUNT] = { 1, 2, 4, 8 };
+    const uint32x4_t equal = vceqq_u32(vld1q_u32(_node->keys), vdupq_n_u32(_key));
+
+    return vaddvq_u32(vandq_u32(equal, vld1q_u32(bits)));
+#else
+    uint32_t mask = 0;
+
+    for (int index = 0; index < FSID_NODE_KEYS_COUNT; ++index)
+        mask |= (uint32_t)(_node->keys[index] == _key) << index;
+
+    return mask;
+#endif
+}
+
+/* Find record with specific string in node chain */
+static fsid_record_t fsid_node_record(const fsid_node_t _node, const char* _string, size_t _length, uint64_t _hash)
+{
+    const uint32_t match = fsid_node_match(_node, fsid_node_key(_length, _hash));
+    const bool overflow = _node->keys[FSID_NODE_KEYS_COUNT - 1] != 0;
+    fsid_record_t record = _node->record;
+
+    /* Inline keys describe first records of chain, memcmp runs only on candidates */
+    for (int index = 0; record && index < FSID_NODE_KEYS_COUNT; ++index, record = record->next)
+    {
+        if (!overflow && !(match >> index))
+            return NULL;
+
+        FSID_PROBE_STEP();
+
+        if (((match >> index) & 1) && record->length == _length && memcmp(record->data, _string, _length) == 0)
+            return record;
+    }
+
+    while (record)
+    {
+        FSID_PROBE_STEP();
+
+        if (record->hash == _hash && record->length == _length && memcmp(record->data, _string, _length) == 0)
+            return record;
+
+        record = record->next;
+    }
+    return NULL;
+}
+
+/* Append record to node chain */
+static void fsid_node_append(fsid_t _fsid, fsid_node_t _node, fsid_record_t _record)
+{
+    fsid_record_t* last = &_node->record;
+    int index = 0;
+
+    while (*last)
+    {
+        last = &(*last)->next;
+        index++;
+    }
+
+    *last = _record;
+
+    if (index < FSID_NODE_KEYS_COUNT)
+        _node->keys[index] = fsid_node_key(_record->length, _record->hash);
+
+#ifdef FSID_STATISTICS
+    if (index > 0)
+        _fsid->chainHistogram[fsid_statistics_bucket((size_t)index)]--;
+
+    _fsid->chainHistogram[fsid_statistics_bucket((size_t)index + 1)]++;
+#endif /* FSID_STATISTICS */
+}
+
+/* Find node of tree with specific hash */
+static fsid_node_t fsid_node_find(const fsid_t _fsid, uint64_t _hash)
+{
+    fsid_node_t node = _fsid->root;
+
+    _hash &= FSID_NODE_HASH_MASK;
+
+    while (node)
+    {
+        FSID_PROBE_STEP();
+
+        if (_hash == fsid_node_hash(node))
+            break;
+        else if (_hash < fsid_node_hash(node))
+            node = node->left;
+        else
+            node = node->right;
+    }
+    return node;
+}
+
+/* Find or insert node of tree with specific hash */
+static fsid_node_t fsid_node_insert(fsid_t _fsid, uint64_t _hash)
+{
+    fsid_node_t stack[FSID_NODE_MAX_LEVEL];
+    fsid_node_t node = _fsid->root;
+    int stackCount = 0;
+    bool newNode = false;
+
+    _hash &= FSID_NODE_HASH_MASK;
+
+    for (;;)
+    {
+        FSID_PROBE_STEP();
+
+        if (!node)
+        {
+            node = fsid_node_create(_fsid, _hash);
+
+            if (!node)
+                return NULL;
+
+            stack[stackCount++] = node;
+            newNode = true;
+            break;
+        }
+        else if (_hash == fsid_node_hash(node))
+        {
+            break;
+        }
+        else if (_hash < fsid_node_hash(node))
+        {
+            stack[stackCount++] = node;
+            node = node->left;
+        }
+        else
+        {
+            stack[stackCount++] = node;
+            node = node->right;
+        }
+    }
+
+    if (newNode)
+    {
+        while (stackCount > 0)
+        {
+            fsid_node_t node = stack[--stackCount];
+            node = fsid_node_balance(node);
+
+            if (stackCount > 0)
+            {
+                fsid_node_t parent = stack[stackCount - 1];
+
+                if (fsid_node_hash(node) < fsid_node_hash(parent))
+                    parent->left = node;
+                else
+                    parent->right = node;
+            }
+            else
+            {
+                _fsid->root = node;
+            }
+        }
+    }
+
+    return node;
+}
+
+/* Remove record from node chain, inline keys are rebuilt from the remaining records */
+static void fsid_node_unlink(fsid_t _fsid, fsid_node_t _node, fsid_record_t _record)
+{
+    fsid_record_t* link = &_node->record;
+    size_t length = 0;
+
+    while (*link != _record)
+        link = &(*link)->next;
+
+    *link = _record->next;
+    memset(_node->keys, 0, sizeof(_node->keys));
+
+    for (fsid_record_t record = _node->record; record; record = record->next, ++length)
+    {
+        if (length < FSID_NODE_KEYS_COUNT)
+            _node->keys[length] = fsid_node_key(record->length, record->hash);
+    }
+
+#ifdef FSID_STATISTICS
+    _fsid->chainHistogram[fsid_statistics_bucket(length + 1)]--;
+
+    if (length > 0)
+        _fsid->chainHistogram[fsid_statistics_bucket(length)]++;
+#endif /* FSID_STATISTICS */
+}
+
+/* Detach node with the lowest hash from subtree, returns the rebalanced subtree */
+static fsid_node_t fsid_node_detach_min(fsid_node_t _node, fsid_node_t* _min)
+{
+    if (!_node->left)
+    {
+        *_min = _node;
+        return _node->right;
+    }
+
+    _node->left = fsid_node_detach_min(_node->left, _min);
+    return fsid_node_balance(_node);
+}
+
+/* Remove node with specific hash from subtree, returns the rebalanced subtree */
+static fsid_node_t fsid_node_remove(fsid_node_t _node, uint64_t _hash)
+{
+    if (_hash < fsid_node_hash(_node))
+    {
+        _node->left = fsid_node_remove(_node->left, _hash);
+    }
+    else if (_hash > fsid_node_hash(_node))
+    {
+        _node->right = fsid_node_remove(_node->right, _hash);
+    }
+    else
+    {
+        fsid_node_t min = NULL;
+
+        if (!_node->left || !_node->right)
+            return _node->left ? _node->left : _node->right;
+
+        /* Successor takes the place of the node */
+        fsid_node_t right = fsid_node_detach_min(_node->right, &min);
+
+        min->left = _node->left;
+        min->right = right;
+        return fsid_node_balance(min);
+    }
+
+    return fsid_node_balance(_node);
+}
+
+/* Match control bytes of group with tag, returns bit mask of matched slots */
+static inline uint32_t fsid_table_match(const uint8_t* _group, uint8_t _tag)
+{
+#if defined(FSID_SSE2)
+    const __m128i group = _mm_loadu_si128((const __m128i*)_group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)_tag)));
+#elif defined(FSID_NEON)
+    static const uint8_t bits[FSID_TABLE_GROUP_WIDTH] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x16_t match = vandq_u8(vceqq_u8(vld1q_u8(_group), vdupq_n_u8(_tag)), vld1q_u8(bits));
+    return (uint32_t)vaddv_u8(vget_low_u8(match)) | ((uint32_t)vaddv_u8(vget_high_u8(match)) << 8);
+#else
+    uint32_t mask = 0;
+
+    for (int index = 0; index < FSID_TABLE_GROUP_WIDTH; ++index)
+        mask |= (uint32_t)(_group[index] == _tag) << index;
+
+    return mask;
+#endif
+}
+
+/* Index of lowest bit in non-zero mask */
+static inline int fsid_table_first(uint32_t _mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(_mask);
+#else
+    int index = 0;
+
+    while (!(_mask & 1))
+    {
+        _mask >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/* Tag stored in control byte */
+static inline uint8_t fsid_table_tag(uint64_t _hash)
+{
+    return (uint8_t)(_hash & FSID_TABLE_TAG_MASK);
+}
+
+/* First probed group */
+static inline size_t fsid_table_group(const fsid_table_t _table, uint64_t _hash)
+{
+    return (size_t)(_hash >> FSID_TABLE_TAG_BITS) & (_table->capacity / FSID_TABLE_GROUP_WIDTH - 1);
+}
+
+/* Check control byte of slot with string, empty and deleted slots have the high bit set */
+static inline bool fsid_table_full(uint8_t _ctrl)
+{
+    return !(_ctrl & FSID_TABLE_CTRL_EMPTY);
+}
+
+/* Size of hash table with specific capacity */
+static inline size_t fsid_table_size(size_t _capacity)
+{
+    return sizeof(struct fsid_table_struct) + sizeof(struct fsid_slot_struct) * (_capacity - 1) + _capacity;
+}
+
+/* Create empty hash table, capacity is power of two and multiple of the group width */
+static fsid_table_t fsid_table_create(fsid_t _fsid, size_t _capacity)
+{
+    fsid_table_t table = (fsid_table_t)fsid_alloc_func(_fsid, fsid_table_size(_capacity));
+
+    if (!table)
+        return NULL;
+
+    table->retired = NULL;
+    table->epoch = 0;
+    table->capacity = _capacity;
+    table->count = 0;
+    table->growthLeft = _capacity - _capacity / 8;
+
+#ifdef FSID_STATISTICS
+    table->maxProbe = 0;
+    memset(table->probeHistogram, 0, sizeof(table->probeHistogram));
+#endif /* FSID_STATISTICS */
+
+    table->ctrl = (uint8_t*)(table->slots + _capacity);
+    memset(table->ctrl, FSID_TABLE_CTRL_EMPTY, _capacity);
+    return table;
+}
+
+/* Destroy hash table */
+static void fsid_table_destroy(fsid_t _fsid, fsid_table_t _table)
+{
+    fsid_free_func(_fsid, _table, fsid_table_size(_table->capacity));
+}
+
+/* Fill slot with string kept inline */
+static inline fsid_slot_t fsid_slot_inline(fsid_slot_t _slot, const char* _string, size_t _length, int _value)
+{
+    memset(_slot->key, 0, sizeof(_slot->key));
+    memcpy(_slot->key, _string, _length);
+    _slot->length = (uint8_t)_length;
+    _slot->value = _value;
+    return _slot;
+}
+
+/* Fill slot with record */
+static inline fsid_slot_t fsid_slot_record(fsid_slot_t _slot, fsid_record_t _record)
+{
+    memset(_slot->key, 0, sizeof(_slot->key));
+    memcpy(_slot->key, &_record, sizeof(_record));
+    _slot->length = 0;
+    _slot->value = _record->value;
+    return _slot;
+}
+
+/* Record of slot which doesn't keep its string inline */
+static inline fsid_record_t fsid_slot_get_record(const struct fsid_slot_struct* _slot)
+{
+    fsid_record_t record;
+
+    memcpy(&record, _slot->key, sizeof(record));
+    return record;
+}
+
+/* Check slot for string, _probe is the inline slot of string or NULL if the string is too long to be inline */
+static inline bool fsid_slot_equal(const struct fsid_slot_struct* _slot, const struct fsid_slot_struct* _probe, const char* _string, size_t _length, uint64_t _hash)
+{
+    if (_slot->length == 0)
+    {
+        const fsid_record_t record = fsid_slot_get_record(_slot);
+
+        return record->hash == _hash && record->length == _length && memcmp(record->data, _string, _length) == 0;
+    }
+
+    if (!_probe)
+        return false;
+
+    /* Key and length of default slot take one vector */
+#if defined(FSID_SSE2)
+    if (FSID_TABLE_KEY_SIZE + 1 == 16)
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)_slot->key), _mm_loadu_si128((const __m128i*)_probe->key))) == 0xffff;
+#elif defined(FSID_NEON)
+    if (FSID_TABLE_KEY_SIZE + 1 == 16)
+        return vminvq_u8(vceqq_u8(vld1q_u8((const uint8_t*)_slot->key), vld1q_u8((const uint8_t*)_probe->key))) == 0xff;
+#endif
+
+    return memcmp(_slot->key, _probe->key, FSID_TABLE_KEY_SIZE + 1) == 0;
+}
+
+/* Hash of string in slot */
+static inline uint64_t fsid_slot_hash(const fsid_t _fsid, const struct fsid_slot_struct* _slot)
+{
+    if (_slot->length == 0)
+        return fsid_slot_get_record(_slot)->hash;
+
+    return fsid_record_hash(_fsid->values->records[_slot->value]);
+}
+
+/* Find value of string in hash table */
+static int fsid_table_find(const fsid_table_t _table, const char* _string, size_t _length, uint64_t _hash)
+{
+    if (!_table)
+        return FSID_ERR_INVALID_VALUE;
+
+    struct fsid_slot_struct inlineSlot;
+    const fsid_slot_t probe = _length <= FSID_INLINE_KEY_LENGTH ? fsid_slot_inline(&inlineSlot, _string, _length, 0) : NULL;
+    const size_t groupMask = _table->capacity / FSID_TABLE_GROUP_WIDTH - 1;
+    const uint8_t tag = fsid_table_tag(_hash);
+    size_t group = fsid_table_group(_table, _hash);
+
+    for (size_t step = 1;; ++step)
+    {
+        const uint8_t* ctrl = _table->ctrl + group * FSID_TABLE_GROUP_WIDTH;
+        uint32_t match = fsid_table_match(ctrl, tag);
+
+        FSID_PROBE_STEP();
+
+        while (match)
+        {
+            const fsid_slot_t slot = &_table->slots[group * FSID_TABLE_GROUP_WIDTH + fsid_table_first(match)];
+            const int value = FSID_LOAD_ACQUIRE(&slot->value);
+
+            if (value > 0 && fsid_slot_equal(slot, probe, _string, _length, _hash))
+                return value;
+
+            match &= match - 1;
+        }
+
+        if (fsid_table_match(ctrl, FSID_TABLE_CTRL_EMPTY))
+            return FSID_ERR_INVALID_VALUE;
+
+        group = (group + step) & groupMask;
+    }
+}
+
+/* Copy slot into hash table with a free slot */
+static void fsid_table_put(fsid_table_t _table, const struct fsid_slot_struct* _slot, uint64_t _hash)
+{
+    const size_t groupMask = _table->capacity / FSID_TABLE_GROUP_WIDTH - 1;
+    size_t group = fsid_table_group(_table, _hash);
+
+    for (size_t step = 1;; ++step)
+    {
+        uint32_t empty = fsid_table_match(_table->ctrl + group * FSID_TABLE_GROUP_WIDTH, FSID_TABLE_CTRL_EMPTY);
+
+        if (empty)
+        {
+            const size_t index = group * FSID_TABLE_GROUP_WIDTH + fsid_table_first(empty);
+            fsid_slot_t slot = &_table->slots[index];
+
+            /* Value is published after the key and before the tag, so readers matching the tag see the complete slot */
+            memcpy(slot->key, _slot->key, sizeof(slot->key));
+            slot->length = _slot->length;
+            FSID_STORE_RELEASE(&slot->value, _slot->value);
+            FSID_STORE_RELEASE(&_table->ctrl[index], fsid_table_tag(_hash));
+            _table->count++;
+            _table->growthLeft--;
+
+#ifdef FSID_STATISTICS
+            _table->probeHistogram[fsid_statistics_bucket(step)]++;
+
+            if (step > _table->maxProbe)
+                _table->maxProbe = step;
+#endif /* FSID_STATISTICS */
+            return;
+        }
+
+        group = (group + step) & groupMask;
+    }
+}
+
+/* Claim empty slot for _slot by compare-exchange of its control byte, returns value of _slot or value of the string inserted first by another writer */
+static int fsid_table_claim(fsid_table_t _table, const struct fsid_slot_struct* _slot, const char* _string, size_t _length, uint64_t _hash)
+{
+    struct fsid_slot_struct inlineSlot;
+    const fsid_slot_t probe = _length <= FSID_INLINE_KEY_LENGTH ? fsid_slot_inline(&inlineSlot, _string, _length, 0) : NULL;
+    const size_t groupMask = _table->capacity / FSID_TABLE_GROUP_WIDTH - 1;
+    const uint8_t tag = fsid_table_tag(_hash);
+    size_t group = fsid_table_group(_table, _hash);
+
+    for (size_t step = 1;; ++step)
+    {
+        uint8_t* ctrl = _table->ctrl + group * FSID_TABLE_GROUP_WIDTH;
+
+        for (;;)
+        {
+            /* Groups are claimed in slot order, a racing insert of the string has claimed a slot before the first empty one */
+            const uint32_t empty = fsid_table_match(ctrl, FSID_TABLE_CTRL_EMPTY);
+            const uint32_t claimed = empty ? ((uint32_t)1 << fsid_table_first(empty)) - 1 : ((uint32_t)1 << FSID_TABLE_GROUP_WIDTH) - 1;
+
+            /* Slots being published by other writers may keep the string */
+            if (fsid_table_match(ctrl, FSID_TABLE_CTRL_BUSY) & claimed)
+            {
+                fsid_yield();
+                continue;
+            }
+
+            FSID_FENCE_ACQUIRE();
+
+            uint32_t match = fsid_table_match(ctrl, tag) & claimed;
+
+            while (match)
+            {
+                const fsid_slot_t slot = &_table->slots[group * FSID_TABLE_GROUP_WIDTH + fsid_table_first(match)];
+                const int value = FSID_LOAD_ACQUIRE(&slot->value);
+
+                if (value > 0 && fsid_slot_equal(slot, probe, _string, _length, _hash))
+                    return value;
+
+                match &= match - 1;
+            }
+
+            if (!empty)
+                break;
+
+            const size_t index = group * FSID_TABLE_GROUP_WIDTH + fsid_table_first(empty);
+            uint8_t expected = FSID_TABLE_CTRL_EMPTY;
+
+            if (!FSID_COMPARE_EXCHANGE(&_table->ctrl[index], &expected, (uint8_t)FSID_TABLE_CTRL_BUSY))
+                continue;
+
+            fsid_slot_t slot = &_table->slots[index];
+
+            memcpy(slot->key, _slot->key, sizeof(slot->key));
+            slot->length = _slot->length;
+            FSID_STORE_RELEASE(&slot->value, _slot->value);
+            FSID_STORE_RELEASE(&_table->ctrl[index], tag);
+            FSID_FETCH_ADD(&_table->count, 1);
+
+#ifdef FSID_STATISTICS
+            FSID_FETCH_ADD(&_table->probeHistogram[fsid_statistics_bucket(step)], 1);
+
+            if (step > FSID_LOAD_RELAXED(&_table->maxProbe))
+                FSID_STORE_RELAXED(&_table->maxProbe, step);
+#endif /* FSID_STATISTICS */
+            return _slot->value;
+        }
+
+        group = (group + step) & groupMask;
+    }
+}
+
+/* Mark slot of value deleted, the slot keeps probe sequences passing it intact until the table is rebuilt */
+static void fsid_table_erase(fsid_table_t _table, uint64_t _hash, int _value)
+{
+    const size_t groupMask = _table->capacity / FSID_TABLE_GROUP_WIDTH - 1;
+    const uint8_t tag = fsid_table_tag(_hash);
+    size_t group = fsid_table_group(_table, _hash);
+
+    for (size_t step = 1;; ++step)
+    {
+        uint32_t match = fsid_table_match(_table->ctrl + group * FSID_TABLE_GROUP_WIDTH, tag);
+
+        while (match)
+        {
+            const size_t index = group * FSID_TABLE_GROUP_WIDTH + fsid_table_first(match);
+
+            if (_table->slots[index].value == _value)
+            {
+                FSID_STORE_RELEASE(&_table->ctrl[index], FSID_TABLE_CTRL_DELETED);
+                _table->count--;
+
+#ifdef FSID_STATISTICS
+                _table->probeHistogram[fsid_statistics_bucket(step)]--;
+#endif /* FSID_STATISTICS */
+                return;
+            }
+
+            match &= match - 1;
+        }
+
+        group = (group + step) & groupMask;
+    }
+}
+
+/* Free removed blocks and retired hash tables no reader without lock can access anymore */
+static void fsid_reclaim(fsid_t _fsid)
+{
+    const uint64_t oldest = fsid_epoch_oldest(_fsid);
+    size_t count = 0;
+
+    /* Limbo is ordered by epoch, free values have room for all its values */
+    while (count < _fsid->limboCount && _fsid->limbo[count].epoch < oldest)
+    {
+        const fsid_limbo_t retired = &_fsid->limbo[count++];
+
+        if (retired->block)
+            fsid_block_free(_fsid, retired->block, retired->size);
+
+        if (retired->value)
+            _fsid->freeValues[_fsid->freeValuesCount++] = retired->value;
+    }
+
+    if (count)
+    {
+        _fsid->limboCount -= count;
+        memmove(_fsid->limbo, _fsid->limbo + count, sizeof(struct fsid_limbo_struct) * _fsid->limboCount);
+    }
+
+    fsid_table_t* link = _fsid->table ? &_fsid->table->retired : NULL;
+
+    /* Retired tables are ordered from the newest */
+    while (link && *link && (*link)->epoch >= oldest)
+        link = &(*link)->retired;
+
+    if (link)
+    {
+        fsid_table_t table = *link;
+
+        *link = NULL;
+
+        while (table)
+        {
+            fsid_table_t retired = table->retired;
+            fsid_table_destroy(_fsid, table);
+            table = retired;
+        }
+    }
+}
+
+/* Move slots of hash table to a new table with specific capacity */
+static bool fsid_table_resize(fsid_t _fsid, size_t _capacity)
+{
+    fsid_table_t table = _fsid->table;
+    fsid_table_t newTable = fsid_table_create(_fsid, _capacity);
+
+    if (!newTable)
+        return false;
+
+    if (table)
+    {
+        for (size_t index = 0; index < table->capacity; ++index)
+        {
+            if (fsid_table_full(table->ctrl[index]))
+                fsid_table_put(newTable, &table->slots[index], fsid_slot_hash(_fsid, &table->slots[index]));
+        }
+
+        if (fsid_readers_unlocked(_fsid))
+            newTable->retired = table;
+        else
+            fsid_table_destroy(_fsid, table);
+    }
+
+    FSID_STORE_RELEASE(&_fsid->table, newTable);
+
+    /* Readers without lock may still use the old table, it is freed once they left the epoch it was retired in */
+    if (table && fsid_readers_unlocked(_fsid))
+    {
+        table->epoch = fsid_epoch_advance(_fsid);
+        fsid_reclaim(_fsid);
+    }
+
+    return true;
+}
+
+/* Make room for one more record in hash table */
+static bool fsid_table_reserve(fsid_t _fsid)
+{
+    fsid_table_t table = _fsid->table;
+
+    if (table && table->growthLeft > 0)
+        return true;
+
+    if (!table)
+        return fsid_table_resize(_fsid, FSID_TABLE_GROUP_WIDTH);
+
+    /* Table filled mostly by deleted slots is rebuilt at the same capacity */
+    const bool deleted = table->count < (table->capacity - table->capacity / 8) / 2;
+
+    return fsid_table_resize(_fsid, deleted ? table->capacity : table->capacity * 2);
+}
+
+/* Hash batch strings, empty and invalid strings are resolved immediately and excluded from batch */
+static size_t fsid_batch_hash(fsid_t _fsid, fsid_batch_t _batch, const char* const* _strings, const size_t* _lengths, size_t _count, int* _values, int* _result)
+{
+    size_t count = 0;
+
+    for (size_t index = 0; index < _count; ++index)
+    {
+        const char* string = _strings[index];
+
+        if (!string)
+        {
+            _values[index] = *_result = FSID_ERR_INVALID_PARAM;
+            continue;
+        }
+
+        const size_t length = _lengths ? _lengths[index] : strlen(string);
+
+        if (length == 0)
+        {
+            _values[index] = FSID_EMPTY_STRING_VALUE;
+            continue;
+        }
+
+        _batch[count].hash = fsid_hash_func(_fsid, string, length);
+        _batch[count].key = (uint32_t)(_batch[count].hash >> 32);
+        _batch[count].index = index;
+        _batch[count].string = string;
+        _batch[count].length = length;
+        count++;
+    }
+    return count;
+}
+
+/* Stable sort of batch by key, returns sorted buffer which is _batch or _scratch */
+static fsid_batch_t fsid_batch_sort(fsid_batch_t _batch, fsid_batch_t _scratch, size_t _count)
+{
+    if (_count < FSID_BATCH_SORT_THRESHOLD)
+        return _batch;
+
+    /* Histograms of radix passes cost more than insertion into short batch */
+    if (_count < FSID_BATCH_RADIX_THRESHOLD)
+    {
+        for (size_t index = 1; index < _count; ++index)
+        {
+            const struct fsid_batch_struct entry = _batch[index];
+            size_t position = index;
+
+            while (position > 0 && _batch[position - 1].key > entry.key)
+            {
+                _batch[position] = _batch[position - 1];
+                position--;
+            }
+
+            _batch[position] = entry;
+        }
+        return _batch;
+    }
+
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        size_t offsets[256] = { 0 };
+
+        for (size_t index = 0; index < _count; ++index)
+            offsets[(_batch[index].key >> shift) & 0xff]++;
+
+        /* Skip pass when all keys have the same digit */
+        if (offsets[(_batch[0].key >> shift) & 0xff] == _count)
+            continue;
+
+        size_t total = 0;
+
+        for (int digit = 0; digit < 256; ++digit)
+        {
+            const size_t count = offsets[digit];
+            offsets[digit] = total;
+            total += count;
+        }
+
+        for (size_t index = 0; index < _count; ++index)
+            _scratch[offsets[(_batch[index].key >> shift) & 0xff]++] = _batch[index];
+
+        fsid_batch_t swap = _batch;
+        _batch = _scratch;
+        _scratch = swap;
+    }
+    return _batch;
+}
+
+/* Record associated with local value */
+static inline fsid_record_t fsid_value_record(const fsid_t _fsid, int _value)
+{
+    fsid_value_table_t values = FSID_LOAD_ACQUIRE(&_fsid->values);
+
+    if (_value > 0 && values && (size_t)_value < values->capacity)
+        return FSID_LOAD_ACQUIRE(&values->records[_value]);
+
+    return NULL;
+}
+
+/* Generation of local value of bounded broker, advanced each time the value is reused */
+static inline int fsid_value_generation(const fsid_t _fsid, int _value)
+{
+    fsid_value_table_t values = FSID_LOAD_ACQUIRE(&_fsid->values);
+
+    return FSID_LOAD_RELAXED(&values->generations[_value]);
+}
+
+/* Record of value tagged with generation by bounded broker, replaces the value by local value, NULL if its string was evicted or removed */
+static inline fsid_record_t fsid_tagged_record(const fsid_t _fsid, int* _value)
+{
+    if (!_fsid->generationBits)
+        return fsid_value_record(_fsid, *_value);
+
+    const int generation = *_value & FSID_GENERATION_MASK;
+
+    *_value >>= FSID_GENERATION_BITS;
+
+    /* Generation of reused value is advanced before its new record is published, so the record is loaded first */
+    const fsid_record_t record = fsid_value_record(_fsid, *_value);
+
+    return record && fsid_value_generation(_fsid, *_value) == generation ? record : NULL;
+}
+
+/* Mark string of local value recently used for eviction by bounded broker, readers without lock mark strings concurrently */
+static inline void fsid_value_touch(const fsid_t _fsid, int _value)
+{
+    if (!_fsid->generationBits || _value <= FSID_EMPTY_STRING_VALUE)
+        return;
+
+    fsid_value_table_t values = FSID_LOAD_ACQUIRE(&_fsid->values);
+
+    if (!FSID_LOAD_RELAXED(&values->referenced[_value]))
+        FSID_STORE_RELAXED(&values->referenced[_value], 1);
+}
+
+/* Convert local value of broker to public value, bounded brokers tag it with generation of the value */
+static inline int fsid_public_value(const fsid_t _broker, int _value)
+{
+    if (_value <= FSID_EMPTY_STRING_VALUE)
+        return _value;
+
+    unsigned value = (unsigned)_value;
+
+    if (_broker->generationBits)
+        value = (value << FSID_GENERATION_BITS) | (unsigned)fsid_value_generation(_broker, _value);
+
+    return (int)((value << _broker->shardBits) | _broker->shardIndex);
+}
+
+/* Convert local value of string found by check to public value, bounded brokers mark the string referenced */
+static inline int fsid_public_reference(const fsid_t _broker, int _value)
+{
+    fsid_value_touch(_broker, _value);
+    return fsid_public_value(_broker, _value);
+}
+
+/* Bucket of minimal perfect hash, 60% of keys go to the first 30% of buckets */
+static inline uint64_t fsid_frozen_bucket(uint64_t _hash, uint64_t _bucketsCount)
+{
+    const uint64_t dense = _bucketsCount * 3 / 10 + 1;
+    const uint64_t low = _hash & 0xffffffff;
+
+    if ((_hash >> 32) < FSID_FROZEN_DENSE_THRESHOLD)
+        return (low * dense) >> 32;
+
+    return dense + ((low * (_bucketsCount - dense)) >> 32);
+}
+
+/* Position of key in table of minimal perfect hash displaced by bucket pilot */
+static inline uint64_t fsid_frozen_position(uint64_t _hash, uint32_t _pilot, uint64_t _tableSize)
+{
+    const uint64_t mixed = fsid_mix(_hash ^ fsid_mix(_pilot, FSID_HASH_SECRET1), FSID_HASH_SECRET2);
+
+    return ((mixed & 0xffffffff) * _tableSize) >> 32;
+}
+
+/* String of frozen entry, NULL if entry is out of image */
+static inline const char* fsid_frozen_string(const fsid_frozen_t _frozen, const uint8_t* _entry, size_t* _length)
+{
+    const uint64_t offset = fsid_read64(_entry);
+    const uint64_t length = fsid_read32(_entry + 16);
+
+    if (offset >= _frozen->blobSize || length >= _frozen->blobSize - offset)
+        return NULL;
+
+    *_length = (size_t)length;
+    return _frozen->strings + offset;
+}
+
+/* Find value of string in frozen image */
+static int fsid_frozen_find(const fsid_frozen_t _frozen, const char* _string, size_t _length, uint64_t _hash)
+{
+    if (!_frozen->count)
+        return FSID_ERR_INVALID_VALUE;
+
+    FSID_PROBE_STEP();
+
+    const uint64_t bucket = fsid_frozen_bucket(_hash, _frozen->bucketsCount);
+    uint64_t position = fsid_frozen_position(_hash, fsid_read16(_frozen->pilots + bucket * 2), _frozen->tableSize);
+
+    if (position >= _frozen->count)
+        position = fsid_read32(_frozen->remap + (position - _frozen->count) * 4);
+
+    if (position >= _frozen->count)
+        return FSID_ERR_INVALID_VALUE;
+
+    const uint8_t* entry = _frozen->entries + position * FSID_FROZEN_ENTRY_SIZE;
+    size_t length = 0;
+
+    if (fsid_read64(entry + 8) != _hash)
+        return FSID_ERR_INVALID_VALUE;
+
+    const char* string = fsid_frozen_string(_frozen, entry, &length);
+
+    if (!string || length != _length || memcmp(string, _string, _length) != 0)
+        return FSID_ERR_INVALID_VALUE;
+
+    return (int)fsid_read32(entry + 20);
+}
+
+/* Slot of value in value table of frozen image, generation of bounded broker is left out of the value between local value and shard */
+static inline uint64_t fsid_frozen_slot(int _value, uint32_t _generationBits, uint32_t _generationShift)
+{
+    const uint64_t value = (uint64_t)_value;
+
+    return ((value >> (_generationShift + _generationBits)) << _generationShift) | (value & (((uint64_t)1 << _generationShift) - 1));
+}
+
+/* Entry of slot in value table of frozen image, NULL if the slot holds no string */
+static inline const uint8_t* fsid_frozen_slot_entry(const fsid_frozen_t _frozen, uint64_t _slot)
+{
+    if (_slot <= FSID_EMPTY_STRING_VALUE || _slot >= _frozen->valuesCount)
+        return NULL;
+
+    const uint64_t index = fsid_read32(_frozen->values + (size_t)_slot * 4);
+
+    if (index == 0 || index > _frozen->count)
+        return NULL;
+
+    return _frozen->entries + (index - 1) * FSID_FROZEN_ENTRY_SIZE;
+}
+
+/* Find string of value in frozen image, the entry holds the whole value so values of older generations are rejected */
+static const char* fsid_frozen_value(const fsid_frozen_t _frozen, int _value, size_t* _length)
+{
+    if (_value <= FSID_EMPTY_STRING_VALUE)
+        return NULL;
+
+    const uint8_t* entry = fsid_frozen_slot_entry(_frozen, fsid_frozen_slot(_value, _frozen->generationBits, _frozen->generationShift));
+
+    if (!entry || fsid_read32(entry + 20) != (uint32_t)_value)
+        return NULL;
+
+    return fsid_frozen_string(_frozen, entry, _length);
+}
+
+/* Thread-safe methods */
+
+int fsid_check_stringlen_safe(const fsid_t _fsid, const char* _string, size_t _length, const uint64_t _hash)
+{
+    fsid_record_t record = NULL;
+
+    if (_fsid->engine == FSID_ENGINE_FROZEN)
+    {
+        return fsid_frozen_find(_fsid->frozen, _string, _length, _hash);
+    }
+    else if (_fsid->engine == FSID_ENGINE_HASHTABLE)
+    {
+        return fsid_table_find(FSID_LOAD_ACQUIRE(&_fsid->table), _string, _length, _hash);
+    }
+    else
+    {
+        fsid_node_t node = fsid_node_find(_fsid, _hash);
+
+        if (node)
+            record = fsid_node_record(node, _string, _length, _hash);
+    }
+
+    return record ? record->value : FSID_ERR_INVALID_VALUE;
+}
+
+/* Remove string of local value, its memory and value are reused by later inserts */
+static int fsid_remove_value_safe(fsid_t _fsid, int _value)
+{
+    const fsid_record_t record = fsid_value_record(_fsid, _value);
+
+    if (!record)
+        return FSID_ERR_INVALID_VALUE;
+
+    /* Values in limbo of bounded broker become free values once reclaimed, other values are free at once */
+    const size_t pendingValues = _fsid->generationBits ? _fsid->limboCount : 0;
+    int* values = (int*)fsid_array_grow(_fsid, _fsid->freeValues, _fsid->freeValuesCount + pendingValues, &_fsid->freeValuesCapacity, sizeof(int));
+
+    if (!values)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    _fsid->freeValues = values;
+
+    const bool limbo = fsid_epoch_used(_fsid);
+
+    /* Limbo holds values of removed strings too, it is reclaimed by every removal */
+    if (limbo)
+    {
+        fsid_reclaim(_fsid);
+
+        fsid_limbo_t entries = (fsid_limbo_t)fsid_array_grow(_fsid, _fsid->limbo, _fsid->limboCount, &_fsid->limboCapacity, sizeof(struct fsid_limbo_struct));
+
+        if (!entries)
+            return FSID_ERR_OUT_OF_MEMORY;
+
+        _fsid->limbo = entries;
+    }
+
+    const uint64_t hash = fsid_record_hash(record);
+    const size_t length = fsid_record_length(record);
+    const size_t size = fsid_record_size(_fsid, record);
+    const fsid_short_t entry = fsid_record_short(record);
+    void* block = entry ? (void*)entry : (void*)record;
+
+    _fsid->liveCount--;
+    _fsid->liveBytes -= size;
+    _fsid->version++;
+
+#ifdef FSID_STATISTICS
+    _fsid->recordsCount--;
+    _fsid->stringBytes -= length;
+
+    if (entry || record->data == record->buffer)
+        _fsid->stringsStored -= length + 1;
+#endif /* FSID_STATISTICS */
+
+    if (_fsid->engine == FSID_ENGINE_HASHTABLE)
+    {
+        fsid_table_erase(_fsid->table, hash, _value);
+    }
+    else
+    {
+        fsid_node_t node = fsid_node_find(_fsid, hash);
+
+        fsid_node_unlink(_fsid, node, record);
+
+        if (!node->record)
+        {
+            _fsid->root = fsid_node_remove(_fsid->root, hash & FSID_NODE_HASH_MASK);
+            node->left = _fsid->freeNodes;
+            _fsid->freeNodes = node;
+
+#ifdef FSID_STATISTICS
+            _fsid->nodesCount--;
+#endif /* FSID_STATISTICS */
+        }
+    }
+
+    FSID_STORE_RELEASE(&_fsid->values->records[_value], NULL);
+
+    /* Readers without lock may still compare the string or hand out its value, bounded broker reuses the value after they leave the current epoch */
+    if (limbo)
+    {
+        fsid_limbo_t retired = &_fsid->limbo[_fsid->limboCount++];
+
+        retired->block = block;
+        retired->size = size;
+        retired->value = _fsid->generationBits ? _value : FSID_EMPTY_STRING_VALUE;
+        retired->epoch = fsid_epoch_advance(_fsid);
+    }
+    else
+    {
+        fsid_block_free(_fsid, block, size);
+    }
+
+    /* Lock-free inserts take new values only */
+    if ((!limbo || !_fsid->generationBits) && !(_fsid->flags & FSID_FLAG_LOCKFREE_WRITERS))
+        _fsid->freeValues[_fsid->freeValuesCount++] = _value;
+
+    return FSID_SUCCESSFUL;
+}
+
+/* Evict strings of bounded broker the clock hand finds unreferenced until the broker fits its budget, the string of _value is kept */
+static void fsid_evict(fsid_t _fsid, int _value)
+{
+    const size_t maxEntries = _fsid->maxEntries;
+    const size_t maxBytes = _fsid->maxBytes;
+
+    if ((!maxEntries || _fsid->liveCount <= maxEntries) && (!maxBytes || _fsid->liveBytes <= maxBytes))
+        return;
+
+    /* Some of the budget is freed at once, evictions and the epochs they start come in batches */
+    const size_t entries = maxEntries - maxEntries / FSID_EVICTION_SLACK;
+    const size_t bytes = maxBytes - maxBytes / FSID_EVICTION_SLACK;
+    const fsid_value_table_t values = _fsid->values;
+
+    /* Second pass of the hand finds every reference cleared */
+    for (size_t step = 0; step < (size_t)_fsid->nextValue * 2; ++step)
+    {
+        if ((!maxEntries || _fsid->liveCount <= entries) && (!maxBytes || _fsid->liveBytes <= bytes))
+            break;
+
+        const int value = _fsid->clockHand > FSID_EMPTY_STRING_VALUE && _fsid->clockHand < _fsid->nextValue ? _fsid->clockHand : FSID_EMPTY_STRING_VALUE + 1;
+
+        _fsid->clockHand = value + 1;
+
+        if (value == _value || !values->records[value])
+            continue;
+
+        if (FSID_LOAD_RELAXED(&values->referenced[value]))
+        {
+            FSID_STORE_RELAXED(&values->referenced[value], 0);
+            continue;
+        }
+
+        if (fsid_remove_value_safe(_fsid, value) != FSID_SUCCESSFUL)
+            break;
+
+#ifdef FSID_STATISTICS
+        _fsid->evictions++;
+#endif /* FSID_STATISTICS */
+    }
+}
+
+/* Take value assigned to inserted string */
+static inline void fsid_value_take(fsid_t _fsid)
+{
+    if (!_fsid->freeValuesCount)
+    {
+        _fsid->nextValue++;
+        return;
+    }
+
+    const int value = _fsid->freeValues[--_fsid->freeValuesCount];
+
+    /* Bounded broker keeps values handed out for the removed string invalid */
+    if (_fsid->generationBits)
+    {
+        uint8_t* generation = &_fsid->values->generations[value];
+
+        FSID_STORE_RELAXED(generation, (uint8_t)((*generation + 1) & FSID_GENERATION_MASK));
+    }
+}
+
+int fsid_insert_stringlen_safe(fsid_t _fsid, const char* _string, size_t _length, const uint64_t _hash, bool _external)
+{
+    fsid_node_t node = NULL;
+    fsid_record_t record = NULL;
+
+    if (_fsid->engine == FSID_ENGINE_FROZEN)
+    {
+        const int value = fsid_frozen_find(_fsid->frozen, _string, _length, _hash);
+
+        return value == FSID_ERR_INVALID_VALUE ? FSID_ERR_READ_ONLY : value;
+    }
+    else if (_fsid->engine == FSID_ENGINE_HASHTABLE)
+    {
+        const int value = fsid_table_find(_fsid->table, _string, _length, _hash);
+
+        if (value > 0)
+        {
+            fsid_value_touch(_fsid, value);
+            return value;
+        }
+
+        if (!fsid_table_reserve(_fsid))
+            return FSID_ERR_OUT_OF_MEMORY;
+    }
+    else
+    {
+        node = fsid_node_insert(_fsid, _hash);
+
+        if (!node)
+            return FSID_ERR_OUT_OF_MEMORY;
+
+        record = fsid_node_record(node, _string, _length, _hash);
+
+        if (record)
+        {
+            fsid_value_touch(_fsid, record->value);
+            return record->value;
+        }
+    }
+
+    /* Values of removed strings are reused first, the latest removed one first */
+    const int value = _fsid->freeValuesCount ? _fsid->freeValues[_fsid->freeValuesCount - 1] : _fsid->nextValue;
+
+    if (value >= _fsid->maxValue)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    if (!fsid_value_table_reserve(_fsid, value))
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    struct fsid_slot_struct slot;
+
+    /* Hash table keeps short copied strings inline, the value table refers to their only copy */
+    if (!node && !_external && _length <= FSID_INLINE_KEY_LENGTH)
+    {
+        record = fsid_short_create(_fsid, _string, _length, _hash);
+
+        if (!record)
+            return FSID_ERR_OUT_OF_MEMORY;
+
+        fsid_value_take(_fsid);
+        FSID_STORE_RELEASE(&_fsid->values->records[value], record);
+        fsid_table_put(_fsid->table, fsid_slot_inline(&slot, _string, _length, value), _hash);
+    }
+    else
+    {
+        record = fsid_record_create(_fsid, value, _string, _length, _hash, _external);
+
+        if (!record)
+            return FSID_ERR_OUT_OF_MEMORY;
+
+        fsid_value_take(_fsid);
+        FSID_STORE_RELEASE(&_fsid->values->records[value], record);
+
+        if (node)
+        {
+            fsid_node_append(_fsid, node, record);
+        }
+        else
+        {
+            fsid_table_put(_fsid->table, fsid_slot_record(&slot, record), _hash);
+        }
+    }
+
+    _fsid->liveCount++;
+    _fsid->liveBytes += fsid_record_size(_fsid, record);
+
+    if (_fsid->generationBits)
+        fsid_evict(_fsid, value);
+
+    return value;
+}
+
+/* Grow hash table and value table of broker with lock-free writers for one more string, inserts are stopped meanwhile */
+static bool fsid_writers_grow(fsid_t _fsid)
+{
+    fsid_exclusive_lock(_fsid);
+    const bool result = fsid_table_reserve(_fsid) && fsid_value_table_reserve(_fsid, _fsid->nextValue);
+    fsid_exclusive_unlock(_fsid);
+
+    return result;
+}
+
+/* Drop record of string lost to a concurrent insert of the same string, readers without lock may have seen it, its block stays unused until fsid_compact */
+static void fsid_record_discard(fsid_t _fsid, fsid_record_t _record)
+{
+#ifdef FSID_STATISTICS
+    const fsid_short_t entry = fsid_record_short(_record);
+    const size_t length = fsid_record_length(_record);
+
+    FSID_FETCH_ADD(&_fsid->recordsCount, (size_t)-1);
+    FSID_FETCH_ADD(&_fsid->stringBytes, (size_t)0 - length);
+
+    if (entry || _record->data == _record->buffer)
+        FSID_FETCH_ADD(&_fsid->stringsStored, (size_t)0 - (length + 1));
+
+    FSID_FETCH_ADD(&_fsid->freeBytes, fsid_record_size(_fsid, _record));
+#endif /* FSID_STATISTICS */
+}
+
+/* Insert string into hash table of broker with lock-free writers, the calling thread is in the epoch of _owner and leaves it while inserts are stopped */
+static int fsid_insert_lockfree(fsid_t _fsid, fsid_t _owner, fsid_thread_t _thread, const char* _string, size_t _length, uint64_t _hash, bool _external)
+{
+    fsid_table_t table = NULL;
+    fsid_value_table_t values = NULL;
+    int value = 0;
+
+    for (;;)
+    {
+        while (FSID_LOAD_SEQ_CST(&_fsid->writersStopped))
+            fsid_writers_wait(_fsid, _owner, _thread);
+
+        /* Tables are replaced only while inserts are stopped */
+        table = FSID_LOAD_ACQUIRE(&_fsid->table);
+        values = FSID_LOAD_ACQUIRE(&_fsid->values);
+
+        const int found = fsid_table_find(table, _string, _length, _hash);
+
+        if (found > 0)
+            return found;
+
+        size_t left = table ? FSID_LOAD_RELAXED(&table->growthLeft) : 0;
+
+        /* Free slot is taken before the value, both are given back if the other one is missing */
+        while (left && !FSID_COMPARE_EXCHANGE(&table->growthLeft, &left, left - 1))
+            ;
+
+        if (left)
+        {
+            value = FSID_LOAD_RELAXED(&_fsid->nextValue);
+
+            while (value < _fsid->maxValue && values && (size_t)value < values->capacity && !FSID_COMPARE_EXCHANGE(&_fsid->nextValue, &value, value + 1))
+                ;
+
+            if (value < _fsid->maxValue && values && (size_t)value < values->capacity)
+                break;
+
+            FSID_FETCH_ADD(&table->growthLeft, 1);
+
+            if (value >= _fsid->maxValue)
+                return FSID_ERR_OUT_OF_MEMORY;
+        }
+
+        fsid_epoch_leave(_owner, _thread);
+        const bool grown = fsid_writers_grow(_fsid);
+        fsid_epoch_enter(_owner, _thread);
+
+        if (!grown)
+            return FSID_ERR_OUT_OF_MEMORY;
+    }
+
+    /* Record is built without lock, the slot is claimed after */
+    struct fsid_slot_struct slot;
+    fsid_record_t record = NULL;
+
+    if (!_external && _length <= FSID_INLINE_KEY_LENGTH)
+    {
+        record = fsid_short_create(_fsid, _string, _length, _hash);
+
+        if (record)
+            fsid_slot_inline(&slot, _string, _length, value);
+    }
+    else
+    {
+        record = fsid_record_create(_fsid, value, _string, _length, _hash, _external);
+
+        if (record)
+            fsid_slot_record(&slot, record);
+    }
+
+    if (!record)
+    {
+        FSID_FETCH_ADD(&table->growthLeft, 1);
+        return FSID_ERR_OUT_OF_MEMORY;
+    }
+
+    FSID_STORE_RELEASE(&values->records[value], record);
+
+    const int winner = fsid_table_claim(table, &slot, _string, _length, _hash);
+
+    if (winner == value)
+    {
+        FSID_FETCH_ADD(&_fsid->liveCount, 1);
+        FSID_FETCH_ADD(&_fsid->liveBytes, fsid_record_size(_fsid, record));
+        return value;
+    }
+
+    /* Value of the lost insert stays unused */
+    FSID_STORE_RELEASE(&values->records[value], NULL);
+    FSID_FETCH_ADD(&table->growthLeft, 1);
+    fsid_record_discard(_fsid, record);
+    return winner;
+}
+
+/* Preallocate storage of broker for _strings more strings of _bytes total length */
+static int fsid_reserve_safe(fsid_t _fsid, size_t _strings, size_t _bytes)
+{
+    const size_t count = (size_t)(_fsid->nextValue - 1) - _fsid->freeValuesCount;
+    const size_t strings = _strings < (size_t)_fsid->maxValue - count ? _strings : (size_t)_fsid->maxValue - count;
+
+    if (strings == 0)
+        return FSID_SUCCESSFUL;
+
+    if (!fsid_value_table_reserve(_fsid, (int)(count + strings)))
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    if (_fsid->engine == FSID_ENGINE_HASHTABLE)
+    {
+        size_t capacity = FSID_TABLE_GROUP_WIDTH;
+
+        while (capacity - capacity / 8 < count + strings)
+            capacity *= 2;
+
+        if ((!_fsid->table || _fsid->table->capacity < capacity) && !fsid_table_resize(_fsid, capacity))
+            return FSID_ERR_OUT_OF_MEMORY;
+    }
+    else
+    {
+        const fsid_node_pool_t pool = _fsid->pool;
+
+        /* Tree of distinct hashes has a node per string */
+        if ((!pool || pool->capacity - pool->count < strings) && !fsid_node_pool_create(_fsid, strings))
+            return FSID_ERR_OUT_OF_MEMORY;
+    }
+
+    /* Records get one chunk large enough for all of them, the tail of the current chunk is left unused */
+    const size_t alignment = _fsid->arenaAlignment;
+    const size_t recordSize = offsetof(struct fsid_record_struct, buffer) + 1 + alignment - 1;
+
+    if (_bytes > SIZE_MAX - strings * recordSize)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    const size_t size = _bytes + strings * recordSize;
+    fsid_arena_t arena = _fsid->arena;
+
+    if (!arena || arena->size - arena->used < size)
+    {
+        fsid_arena_t chunk = fsid_arena_create(_fsid, size);
+
+        if (!chunk)
+            return FSID_ERR_OUT_OF_MEMORY;
+
+        chunk->next = arena;
+        _fsid->arena = chunk;
+    }
+
+    return FSID_SUCCESSFUL;
+}
+
+static int fsid_insert_batch_safe(fsid_t _fsid, fsid_batch_t _batch, fsid_batch_t _scratch, size_t _count, int* _values)
+{
+    int result = FSID_SUCCESSFUL;
+
+    /* Order of index paths: tree by bucket hash, table by first probed group */
+    for (size_t index = 0; index < _count; ++index)
+    {
+        if (_fsid->engine == FSID_ENGINE_HASHTABLE)
+            _batch[index].key = _fsid->table ? (uint32_t)fsid_table_group(_fsid->table, _batch[index].hash) : 0;
+        else
+            _batch[index].key = (uint32_t)(_batch[index].hash >> 32);
+    }
+
+    _batch = fsid_batch_sort(_batch, _scratch, _count);
+
+    for (size_t index = 0; index < _count; ++index)
+    {
+        const size_t position = _batch[index].index;
+        const int value = fsid_insert_stringlen_safe(_fsid, _batch[index].string, _batch[index].length, _batch[index].hash, false);
+
+        if (value < 0)
+            result = value;
+
+        /* Later inserts of the batch may evict the string and reuse its value */
+        _values[position] = fsid_public_value(_fsid, value);
+    }
+    return result;
+}
+
+/* Tree lookups of group interleaved level by level, so cache misses of different strings overlap */
+static void fsid_check_group_tree(const fsid_t* _brokers, const char* const* _strings, const size_t* _lengths, const uint64_t* _hashes, int* _values, size_t _count)
+{
+    fsid_node_t nodes[FSID_BATCH_GROUP_SIZE];
+    bool found[FSID_BATCH_GROUP_SIZE];
+    size_t active = 0;
+
+    for (size_t lane = 0; lane < _count; ++lane)
+    {
+        nodes[lane] = _brokers[lane]->root;
+        found[lane] = false;
+        _values[lane] = FSID_ERR_INVALID_VALUE;
+
+        if (nodes[lane])
+            active++;
+    }
+
+    while (active > 0)
+    {
+        for (size_t lane = 0; lane < _count; ++lane)
+        {
+            fsid_node_t node = nodes[lane];
+
+            if (!node || found[lane])
+                continue;
+
+            const uint64_t hash = _hashes[lane] & FSID_NODE_HASH_MASK;
+
+            if (hash == fsid_node_hash(node))
+            {
+                found[lane] = true;
+                active--;
+                continue;
+            }
+
+            node = hash < fsid_node_hash(node) ? node->left : node->right;
+            nodes[lane] = node;
+
+            if (node)
+                FSID_PREFETCH(node);
+            else
+                active--;
+        }
+    }
+
+    for (size_t lane = 0; lane < _count; ++lane)
+    {
+        if (found[lane])
+        {
+            fsid_record_t record = fsid_node_record(nodes[lane], _strings[lane], _lengths[lane], _hashes[lane]);
+
+            if (record)
+                _values[lane] = record->value;
+        }
+    }
+}
+
+/* Hash table lookups of group interleaved by probing stages */
+static void fsid_check_group_table(const fsid_t* _brokers, const char* const* _strings, const size_t* _lengths, const uint64_t* _hashes, int* _values, size_t _count)
+{
+    fsid_table_t tables[FSID_BATCH_GROUP_SIZE];
+    fsid_slot_t slots[FSID_BATCH_GROUP_SIZE];
+    bool pending[FSID_BATCH_GROUP_SIZE];
+
+    for (size_t lane = 0; lane < _count; ++lane)
+    {
+        const fsid_table_t table = tables[lane] = FSID_LOAD_ACQUIRE(&_brokers[lane]->table);
+
+        _values[lane] = FSID_ERR_INVALID_VALUE;
+
+        if (table)
+            FSID_PREFETCH(table->ctrl + fsid_table_group(table, _hashes[lane]) * FSID_TABLE_GROUP_WIDTH);
+    }
+
+    for (size_t lane = 0; lane < _count; ++lane)
+    {
+        const fsid_table_t table = tables[lane];
+
+        slots[lane] = NULL;
+        pending[lane] = false;
+
+        if (!table)
+            continue;
+
+        const size_t group = fsid_table_group(table, _hashes[lane]) * FSID_TABLE_GROUP_WIDTH;
+        const uint32_t match = fsid_table_match(table->ctrl + group, fsid_table_tag(_hashes[lane]));
+
+        pending[lane] = true;
+
+        if (match)
+        {
+            slots[lane] = &table->slots[group + fsid_table_first(match)];
+            FSID_PREFETCH(slots[lane]);
+        }
+        else if (fsid_table_match(table->ctrl + group, FSID_TABLE_CTRL_EMPTY))
+        {
+            pending[lane] = false;
+        }
+    }
+
+    /* Only long and external strings take one more load */
+    for (size_t lane = 0; lane < _count; ++lane)
+    {
+        const fsid_slot_t slot = slots[lane];
+
+        if (slot && FSID_LOAD_ACQUIRE(&slot->value) > 0 && slot->length == 0)
+            FSID_PREFETCH(fsid_slot_get_record(slot));
+    }
+
+    for (size_t lane = 0; lane < _count; ++lane)
+    {
+        if (!pending[lane])
+            continue;
+
+        const fsid_slot_t slot = slots[lane];
+        struct fsid_slot_struct inlineSlot;
+        const fsid_slot_t probe = _lengths[lane] <= FSID_INLINE_KEY_LENGTH ? fsid_slot_inline(&inlineSlot, _strings[lane], _lengths[lane], 0) : NULL;
+        const int value = slot ? FSID_LOAD_ACQUIRE(&slot->value) : 0;
+
+        /* First candidate is almost always the string, otherwise take the full probing */
+        if (value > 0 && fsid_slot_equal(slot, probe, _strings[lane], _lengths[lane], _hashes[lane]))
+            _values[lane] = value;
+        else
+            _values[lane] = fsid_table_find(tables[lane], _strings[lane], _lengths[lane], _hashes[lane]);
+    }
+}
+
+/* Route string to owning broker */
+static inline uint32_t fsid_shard_index(const fsid_t _fsid, uint64_t _hash)
+{
+    return (uint32_t)((_hash * FSID_SHARD_HASH_FACTOR) >> (64 - _fsid->shardBits));
+}
+
+/* Route string to owning broker */
+static inline fsid_t fsid_route_hash(const fsid_t _fsid, uint64_t _hash)
+{
+    if (!_fsid->shards)
+        return _fsid;
+
+    return _fsid->shards[fsid_shard_index(_fsid, _hash)];
+}
+
+/* Route value to owning broker and replace it by local value of that broker */
+static inline fsid_t fsid_route_value(const fsid_t _fsid, int* _value)
+{
+    if (!_fsid->shards)
+        return _fsid;
+
+    fsid_t shard = _fsid->shards[*_value & ((1 << _fsid->shardBits) - 1)];
+    *_value >>= _fsid->shardBits;
+    return shard;
+}
+
+static int fsid_check_batch_safe(const fsid_t _fsid, const char* const* _strings, const size_t* _lengths, size_t _count, int* _values)
+{
+    fsid_t brokers[FSID_BATCH_GROUP_SIZE];
+    const char* strings[FSID_BATCH_GROUP_SIZE];
+    size_t lengths[FSID_BATCH_GROUP_SIZE];
+    uint64_t hashes[FSID_BATCH_GROUP_SIZE];
+    int values[FSID_BATCH_GROUP_SIZE];
+    size_t positions[FSID_BATCH_GROUP_SIZE];
+    int result = FSID_SUCCESSFUL;
+    size_t index = 0;
+
+    while (index < _count)
+    {
+        size_t count = 0;
+
+        while (index < _count && count < FSID_BATCH_GROUP_SIZE)
+        {
+            const char* string = _strings[index];
+
+            if (!string)
+            {
+                _values[index++] = result = FSID_ERR_INVALID_PARAM;
+                continue;
+            }
+
+            const size_t length = _lengths ? _lengths[index] : strlen(string);
+
+            if (length == 0)
+            {
+                _values[index++] = FSID_EMPTY_STRING_VALUE;
+                continue;
+            }
+
+            strings[count] = string;
+            lengths[count] = length;
+            hashes[count] = fsid_hash_func(_fsid, string, length);
+            brokers[count] = fsid_route_hash(_fsid, hashes[count]);
+            positions[count++] = index++;
+        }
+
+        if (_fsid->engine == FSID_ENGINE_FROZEN)
+        {
+            for (size_t lane = 0; lane < count; ++lane)
+                values[lane] = fsid_frozen_find(_fsid->frozen, strings[lane], lengths[lane], hashes[lane]);
+        }
+        else if (_fsid->engine == FSID_ENGINE_HASHTABLE)
+        {
+            fsid_check_group_table(brokers, strings, lengths, hashes, values, count);
+        }
+        else
+        {
+            fsid_check_group_tree(brokers, strings, lengths, hashes, values, count);
+        }
+
+        for (size_t lane = 0; lane < count; ++lane)
+            _values[positions[lane]] = fsid_public_reference(brokers[lane], values[lane]);
+    }
+    return result;
+}
+
+int fsid_check_value_safe(fsid_t _fsid, int _value, const char** _pointer, size_t* _length)
+{
+    if (_fsid->engine == FSID_ENGINE_FROZEN)
+    {
+        size_t length = 0;
+        const char* string = fsid_frozen_value(_fsid->frozen, _value, &length);
+
+        if (_pointer)
+            *_pointer = string;
+
+        if (_length)
+            *_length = length;
+
+        return string ? FSID_SUCCESSFUL : FSID_ERR_INVALID_VALUE;
+    }
+
+    fsid_record_t record = fsid_tagged_record(_fsid, &_value);
+
+    if (record)
+    {
+        if (_pointer)
+            *_pointer = fsid_record_data(record);
+
+        if (_length)
+            *_length = fsid_record_length(record);
+
+        return FSID_SUCCESSFUL;
+    }
+
+    if (_pointer)
+        *_pointer = NULL;
+
+    if (_length)
+        *_length = 0;
+
+    return FSID_ERR_INVALID_VALUE;
+}
+
+/* Little-endian 32-bit write */
+static inline void fsid_write32(uint8_t* _data, uint32_t _value)
+{
+    for (int index = 0; index < 4; ++index)
+        _data[index] = (uint8_t)(_value >> (index * 8));
+}
+
+/* Little-endian 64-bit write */
+static inline void fsid_write64(uint8_t* _data, uint64_t _value)
+{
+    for (int index = 0; index < 8; ++index)
+        _data[index] = (uint8_t)(_value >> (index * 8));
+}
+
+/* Pass buffered data to write callback */
+static void fsid_writer_flush(fsid_writer_t _writer)
+{
+    if (_writer->used && !_writer->failed && _writer->writeFunc(_writer->userData, _writer->buffer, _writer->used) != _writer->used)
+        _writer->failed = true;
+
+    _writer->used = 0;
+}
+
+/* Append data to snapshot image */
+static void fsid_writer_data(fsid_writer_t _writer, const void* _data, size_t _size)
+{
+    if (_writer->used + _size > FSID_IMAGE_BUFFER_SIZE)
+    {
+        fsid_writer_flush(_writer);
+
+        if (_size > FSID_IMAGE_BUFFER_SIZE)
+        {
+            if (!_writer->failed && _writer->writeFunc(_writer->userData, _data, _size) != _size)
+                _writer->failed = true;
+
+            return;
+        }
+    }
+
+    memcpy(_writer->buffer + _writer->used, _data, _size);
+    _writer->used += _size;
+}
+
+static void fsid_writer_u32(fsid_writer_t _writer, uint32_t _value)
+{
+    uint8_t data[4];
+
+    fsid_write32(data, _value);
+    fsid_writer_data(_writer, data, sizeof(data));
+}
+
+static void fsid_writer_u64(fsid_writer_t _writer, uint64_t _value)
+{
+    uint8_t data[8];
+
+    fsid_write64(data, _value);
+    fsid_writer_data(_writer, data, sizeof(data));
+}
+
+/* Broker owning local values of shard */
+static inline fsid_t fsid_shard(const fsid_t _fsid, uint32_t _shard)
+{
+    return _fsid->shards ? _fsid->shards[_shard] : _fsid;
+}
+
+/* Write section of snapshot image, records are visited in order of public values */
+static void fsid_save_section(const fsid_t _fsid, fsid_writer_t _writer, int _section, int _nextValue)
+{
+    const uint32_t shardsCount = 1u << _fsid->shardBits;
+
+    for (int value = FSID_EMPTY_STRING_VALUE + 1; value < _nextValue; ++value)
+    {
+        for (uint32_t shard = 0; shard < shardsCount; ++shard)
+        {
+            const fsid_t broker = fsid_shard(_fsid, shard);
+            const fsid_record_t record = fsid_value_record(broker, value);
+
+            if (!record)
+                continue;
+
+            if (_section == FSID_IMAGE_SECTION_IDS)
+                fsid_writer_u32(_writer, (uint32_t)fsid_public_value(broker, value));
+            else if (_section == FSID_IMAGE_SECTION_LENGTHS)
+                fsid_writer_u64(_writer, fsid_record_length(record));
+            else if (_section == FSID_IMAGE_SECTION_HASHES)
+                fsid_writer_u64(_writer, fsid_record_hash(record));
+            else
+                fsid_writer_data(_writer, fsid_record_data(record), fsid_record_length(record));
+        }
+    }
+}
+
+/* Write snapshot image: header, ids, lengths, hashes and string blob */
+static void fsid_save_safe(const fsid_t _fsid, fsid_writer_t _writer)
+{
+    const uint32_t shardsCount = 1u << _fsid->shardBits;
+    int nextValue = FSID_EMPTY_STRING_VALUE + 1;
+    uint64_t count = 0;
+    uint64_t blobSize = 0;
+
+    for (uint32_t shard = 0; shard < shardsCount; ++shard)
+    {
+        const fsid_t broker = fsid_shard(_fsid, shard);
+
+        for (int value = FSID_EMPTY_STRING_VALUE + 1; value < broker->nextValue; ++value)
+        {
+            const fsid_record_t record = fsid_value_record(broker, value);
+
+            if (record)
+            {
+                count++;
+                blobSize += fsid_record_length(record);
+            }
+        }
+
+        if (broker->nextValue > nextValue)
+            nextValue = broker->nextValue;
+    }
+
+    uint8_t header[FSID_IMAGE_HEADER_SIZE] = { 0 };
+
+    fsid_write32(header, FSID_IMAGE_MAGIC);
+    fsid_write32(header + 4, FSID_IMAGE_VERSION);
+    fsid_write32(header + 8, _fsid->shardBits);
+    fsid_write32(header + 12, _fsid->generationBits);
+    fsid_write64(header + 16, count);
+    fsid_write64(header + 24, blobSize);
+    fsid_write64(header + 32, fsid_hash_func(_fsid, FSID_IMAGE_PROBE, sizeof(FSID_IMAGE_PROBE) - 1));
+    fsid_writer_data(_writer, header, sizeof(header));
+
+    for (int section = FSID_IMAGE_SECTION_IDS; section <= FSID_IMAGE_SECTION_STRINGS; ++section)
+        fsid_save_section(_fsid, _writer, section, nextValue);
+
+    fsid_writer_flush(_writer);
+}
+
+/* Read exactly _size bytes */
+static bool fsid_read_data(fsid_read _readFunc, void* _userData, void* _data, size_t _size)
+{
+    uint8_t* data = (uint8_t*)_data;
+
+    while (_size)
+    {
+        const size_t size = _readFunc(_userData, data, _size);
+
+        if (size == 0 || size > _size)
+            return false;
+
+        data += size;
+        _size -= size;
+    }
+    return true;
+}
+
+/* Create records of snapshot image in value tables of empty broker */
+static int fsid_load_records(fsid_t _fsid, const uint8_t* _data, size_t _count, uint64_t _blobSize, bool _rehash)
+{
+    const uint8_t* ids = _data;
+    const uint8_t* lengths = ids + _count * sizeof(uint32_t);
+    const uint8_t* hashes = lengths + _count * sizeof(uint64_t);
+    const char* strings = (const char*)(hashes + _count * sizeof(uint64_t));
+    const uint32_t shardMask = (1u << _fsid->shardBits) - 1;
+    uint64_t offset = 0;
+
+    /* Value tables are sized before records are created */
+    for (size_t index = 0; index < _count; ++index)
+    {
+        const uint32_t id = (uint32_t)fsid_read32(ids + index * sizeof(uint32_t));
+        const fsid_t broker = fsid_shard(_fsid, id & shardMask);
+        const int value = (int)(id >> (_fsid->shardBits + broker->generationBits));
+
+        if (id > INT_MAX || value <= FSID_EMPTY_STRING_VALUE || value >= broker->maxValue)
+            return FSID_ERR_INVALID_FORMAT;
+
+        if (value >= broker->nextValue)
+            broker->nextValue = value + 1;
+    }
+
+    for (uint32_t shard = 0; shard <= shardMask; ++shard)
+    {
+        const fsid_t broker = fsid_shard(_fsid, shard);
+
+        if (broker->nextValue > FSID_EMPTY_STRING_VALUE + 1 && !fsid_value_table_reserve(broker, broker->nextValue - 1))
+            return FSID_ERR_OUT_OF_MEMORY;
+    }
+
+    for (size_t index = 0; index < _count; ++index)
+    {
+        const uint32_t id = (uint32_t)fsid_read32(ids + index * sizeof(uint32_t));
+        const uint64_t length = fsid_read64(lengths + index * sizeof(uint64_t));
+
+        if (length == 0 || length > _blobSize - offset)
+            return FSID_ERR_INVALID_FORMAT;
+
+        const char* string = strings + offset;
+        const uint64_t hash = _rehash ? fsid_hash_func(_fsid, string, (size_t)length) : fsid_read64(hashes + index * sizeof(uint64_t));
+        const fsid_t broker = fsid_shard(_fsid, id & shardMask);
+        const int value = (int)(id >> (_fsid->shardBits + broker->generationBits));
+
+        offset += length;
+
+        if (_fsid->shards && fsid_shard_index(_fsid, hash) != (id & shardMask))
+            return FSID_ERR_INVALID_FORMAT;
+
+        if (broker->values->records[value])
+            return FSID_ERR_INVALID_FORMAT;
+
+        fsid_record_t record = NULL;
+
+        if (broker->engine == FSID_ENGINE_HASHTABLE && length <= FSID_INLINE_KEY_LENGTH)
+            record = fsid_short_create(broker, string, (size_t)length, hash);
+        else
+            record = fsid_record_create(broker, value, string, (size_t)length, hash, false);
+
+        if (!record)
+            return FSID_ERR_OUT_OF_MEMORY;
+
+        broker->values->records[value] = record;
+        broker->liveCount++;
+        broker->liveBytes += fsid_record_size(broker, record);
+
+        /* Values of bounded broker keep their generation */
+        if (broker->generationBits)
+            broker->values->generations[value] = (uint8_t)((id >> _fsid->shardBits) & FSID_GENERATION_MASK);
+    }
+
+    return offset == _blobSize ? FSID_SUCCESSFUL : FSID_ERR_INVALID_FORMAT;
+}
+
+/* Build balanced tree from nodes sorted by hash */
+static fsid_node_t fsid_node_build(fsid_node_t* _nodes, size_t _count)
+{
+    if (_count == 0)
+        return NULL;
+
+    const size_t middle = _count / 2;
+    fsid_node_t node = _nodes[middle];
+
+    node->left = fsid_node_build(_nodes, middle);
+    node->right = fsid_node_build(_nodes + middle + 1, _count - middle - 1);
+    fsid_node_fix_height(node);
+    return node;
+}
+
+/* Build index of loaded broker in one pass over its value table */
+static int fsid_load_index(fsid_t _fsid)
+{
+    size_t count = 0;
+
+    for (int value = FSID_EMPTY_STRING_VALUE + 1; value < _fsid->nextValue; ++value)
+    {
+        if (_fsid->values->records[value])
+            count++;
+    }
+
+    /* Values missing in the image belonged to removed strings, the lowest one is reused first */
+    for (int value = _fsid->nextValue - 1; value > FSID_EMPTY_STRING_VALUE; --value)
+    {
+        if (_fsid->values->records[value])
+            continue;
+
+        int* values = (int*)fsid_array_grow(_fsid, _fsid->freeValues, _fsid->freeValuesCount, &_fsid->freeValuesCapacity, sizeof(int));
+
+        if (!values)
+            return FSID_ERR_OUT_OF_MEMORY;
+
+        _fsid->freeValues = values;
+        _fsid->freeValues[_fsid->freeValuesCount++] = value;
+    }
+
+    if (count == 0)
+        return FSID_SUCCESSFUL;
+
+    if (_fsid->engine == FSID_ENGINE_HASHTABLE)
+    {
+        size_t capacity = FSID_TABLE_GROUP_WIDTH;
+
+        while (capacity - capacity / 8 < count)
+            capacity *= 2;
+
+        _fsid->table = fsid_table_create(_fsid, capacity);
+
+        if (!_fsid->table)
+            return FSID_ERR_OUT_OF_MEMORY;
+
+        for (int value = FSID_EMPTY_STRING_VALUE + 1; value < _fsid->nextValue; ++value)
+        {
+            const fsid_record_t record = _fsid->values->records[value];
+
+            if (!record)
+                continue;
+
+            const char* string = fsid_record_data(record);
+            const size_t length = fsid_record_length(record);
+            const uint64_t hash = fsid_record_hash(record);
+
+            if (fsid_table_find(_fsid->table, string, length, hash) > 0)
+                return FSID_ERR_INVALID_FORMAT;
+
+            struct fsid_slot_struct slot;
+
+            if (fsid_record_short(record))
+                fsid_table_put(_fsid->table, fsid_slot_inline(&slot, string, length, value), hash);
+            else
+                fsid_table_put(_fsid->table, fsid_slot_record(&slot, record), hash);
+        }
+        return FSID_SUCCESSFUL;
+    }
+
+    const size_t batchSize = sizeof(struct fsid_batch_struct) * count * 2;
+    fsid_batch_t batch = (fsid_batch_t)fsid_alloc_func(_fsid, batchSize);
+
+    if (!batch)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    size_t index = 0;
+
+    for (int value = FSID_EMPTY_STRING_VALUE + 1; value < _fsid->nextValue; ++value)
+    {
+        const fsid_record_t record = _fsid->values->records[value];
+
+        if (record)
+        {
+            batch[index].key = (uint32_t)(record->hash >> 32);
+            batch[index].hash = record->hash & FSID_NODE_HASH_MASK;
+            batch[index++].index = (size_t)value;
+        }
+    }
+
+    fsid_batch_t sorted = fsid_batch_sort(batch, batch + count, count);
+
+    /* Radix sort orders by high bits only, buckets sharing them are ordered by insertion */
+    for (index = 1; index < count; ++index)
+    {
+        const struct fsid_batch_struct entry = sorted[index];
+        size_t position = index;
+
+        while (position > 0 && sorted[position - 1].hash > entry.hash)
+        {
+            sorted[position] = sorted[position - 1];
+            position--;
+        }
+
+        sorted[position] = entry;
+    }
+
+    /* Unused half of batch holds nodes in hash order */
+    fsid_node_t* nodes = (fsid_node_t*)(sorted == batch ? batch + count : batch);
+    size_t nodesCount = 0;
+    int result = FSID_SUCCESSFUL;
+
+    for (index = 0; index < count && result == FSID_SUCCESSFUL; ++index)
+    {
+        const fsid_record_t record = _fsid->values->records[sorted[index].index];
+
+        if (!nodesCount || fsid_node_hash(nodes[nodesCount - 1]) != sorted[index].hash)
+        {
+            fsid_node_t node = fsid_node_create(_fsid, sorted[index].hash);
+
+            if (!node)
+            {
+                result = FSID_ERR_OUT_OF_MEMORY;
+                break;
+            }
+
+            nodes[nodesCount++] = node;
+        }
+
+        if (fsid_node_record(nodes[nodesCount - 1], record->data, record->length, record->hash))
+            result = FSID_ERR_INVALID_FORMAT;
+        else
+            fsid_node_append(_fsid, nodes[nodesCount - 1], record);
+    }
+
+    _fsid->root = fsid_node_build(nodes, nodesCount);
+    fsid_free_func(_fsid, batch, batchSize);
+    return result;
+}
+
+/* Store nodes of tree in hash order to _nodes if not NULL, returns number of nodes */
+static size_t fsid_node_sorted(fsid_node_t _root, fsid_node_t* _nodes)
+{
+    fsid_node_t stack[FSID_NODE_MAX_LEVEL];
+    fsid_node_t node = _root;
+    int stackCount = 0;
+    size_t count = 0;
+
+    while (node || stackCount > 0)
+    {
+        while (node)
+        {
+            stack[stackCount++] = node;
+            node = node->left;
+        }
+
+        node = stack[--stackCount];
+
+        if (_nodes)
+            _nodes[count] = node;
+
+        count++;
+        node = node->right;
+    }
+    return count;
+}
+
+/* Copy value table entry to _memory and make value table refer to the copy */
+static fsid_record_t fsid_record_move(fsid_t _fsid, fsid_record_t _record, int _value, char* _memory)
+{
+    const fsid_short_t entry = fsid_record_short(_record);
+    fsid_record_t copy = (fsid_record_t)_memory;
+
+    if (entry)
+    {
+        memcpy(_memory, entry, offsetof(struct fsid_short_struct, data) + entry->length + 1);
+        copy = (fsid_record_t)((uintptr_t)_memory | FSID_VALUE_SHORT);
+    }
+    else if (_record->data == _record->buffer)
+    {
+        memcpy(copy, _record, offsetof(struct fsid_record_struct, buffer) + _record->length + 1);
+        copy->data = copy->buffer;
+    }
+    else
+    {
+        memcpy(copy, _record, offsetof(struct fsid_record_struct, buffer));
+    }
+
+    FSID_STORE_RELEASE(&_fsid->values->records[_value], copy);
+    return copy;
+}
+
+/* Replace arena of broker by one chunk holding the moved records */
+static void fsid_compact_arena(fsid_t _fsid, fsid_arena_t _arena, size_t _size, bool _retire)
+{
+    _arena->used = _size;
+    _arena->next = NULL;
+
+#ifdef FSID_STATISTICS
+    _fsid->arenaUsed += _size;
+#endif /* FSID_STATISTICS */
+
+    if (_retire)
+        fsid_arena_retire(_fsid, _fsid->arena);
+    else
+        fsid_arena_destroy_all(_fsid, _fsid->arena);
+
+    /* Blocks of removed strings were in the old chunks, values in limbo still wait for readers */
+    memset(_fsid->freeBlocks, 0, sizeof(_fsid->freeBlocks));
+
+    for (size_t index = 0; index < _fsid->limboCount; ++index)
+        _fsid->limbo[index].block = NULL;
+
+    _fsid->arena = _arena;
+
+#ifdef FSID_STATISTICS
+    _fsid->freeBytes = 0;
+#endif /* FSID_STATISTICS */
+}
+
+/* Rebuild tree into one pool in breadth-first order of a balanced tree, records are packed in the same order */
+static int fsid_compact_tree(fsid_t _fsid, bool _retire)
+{
+    const size_t count = fsid_node_sorted(_fsid->root, NULL);
+
+    if (count == 0)
+        return FSID_SUCCESSFUL;
+
+    const size_t scratchSize = (sizeof(fsid_node_t) + sizeof(struct fsid_compact_range_struct)) * count;
+    fsid_node_t* sorted = (fsid_node_t*)fsid_alloc_func(_fsid, scratchSize);
+
+    if (!sorted)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    fsid_compact_range_t ranges = (fsid_compact_range_t)(sorted + count);
+    size_t size = 0;
+
+    fsid_node_sorted(_fsid->root, sorted);
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        for (fsid_record_t record = sorted[index]->record; record; record = record->next)
+            size += fsid_record_size(_fsid, record);
+    }
+
+    fsid_node_pool_t pool = (fsid_node_pool_t)fsid_alloc_func(_fsid, fsid_node_pool_size(count));
+    fsid_arena_t arena = pool ? fsid_arena_create(_fsid, size) : NULL;
+
+    if (!arena)
+    {
+        if (pool)
+            fsid_free_func(_fsid, pool, fsid_node_pool_size(count));
+
+        fsid_free_func(_fsid, sorted, scratchSize);
+        return FSID_ERR_OUT_OF_MEMORY;
+    }
+
+    fsid_node_t root = NULL;
+    char* memory = arena->data;
+    size_t head = 0;
+    size_t tail = 0;
+
+    pool->capacity = count;
+    pool->count = 0;
+
+    ranges[tail].begin = 0;
+    ranges[tail].end = count;
+    ranges[tail++].link = &root;
+
+    /* Nodes are placed level by level, so the top levels of every search share the first cache lines */
+    while (head < tail)
+    {
+        const struct fsid_compact_range_struct range = ranges[head++];
+        const size_t middle = range.begin + (range.end - range.begin) / 2;
+        fsid_node_t node = &pool->nodes[pool->count++];
+
+        *node = *sorted[middle];
+        node->left = NULL;
+        node->right = NULL;
+        *range.link = node;
+
+        fsid_record_t* last = &node->record;
+
+        for (fsid_record_t record = sorted[middle]->record; record; record = record->next)
+        {
+            *last = fsid_record_move(_fsid, record, record->value, memory);
+            memory += fsid_record_size(_fsid, record);
+            last = &(*last)->next;
+        }
+
+        if (range.begin < middle)
+        {
+            ranges[tail].begin = range.begin;
+            ranges[tail].end = middle;
+            ranges[tail++].link = &node->left;
+        }
+
+        if (middle + 1 < range.end)
+        {
+            ranges[tail].begin = middle + 1;
+            ranges[tail].end = range.end;
+            ranges[tail++].link = &node->right;
+        }
+    }
+
+    /* Children follow their parents, heights are fixed bottom up */
+    for (size_t index = count; index > 0; --index)
+        fsid_node_fix_height(&pool->nodes[index - 1]);
+
+    fsid_node_pool_destroy_all(_fsid, _fsid->pool);
+    pool->next = NULL;
+    _fsid->pool = pool;
+    _fsid->root = root;
+    _fsid->freeNodes = NULL;
+
+#ifdef FSID_STATISTICS
+    _fsid->nodesCount = count;
+    _fsid->nodesCapacity += count;
+#endif /* FSID_STATISTICS */
+
+    fsid_compact_arena(_fsid, arena, size, _retire);
+    fsid_free_func(_fsid, sorted, scratchSize);
+    return FSID_SUCCESSFUL;
+}
+
+/* Rebuild hash table with minimal capacity, records and short strings are packed in slot order */
+static int fsid_compact_table(fsid_t _fsid, bool _retire)
+{
+    fsid_table_t table = _fsid->table;
+
+    if (!table || table->count == 0)
+        return FSID_SUCCESSFUL;
+
+    size_t capacity = FSID_TABLE_GROUP_WIDTH;
+    size_t size = 0;
+
+    while (capacity - capacity / 8 < table->count)
+        capacity *= 2;
+
+    for (size_t index = 0; index < table->capacity; ++index)
+    {
+        if (fsid_table_full(table->ctrl[index]))
+            size += fsid_record_size(_fsid, _fsid->values->records[table->slots[index].value]);
+    }
+
+    fsid_table_t newTable = fsid_table_create(_fsid, capacity);
+    fsid_arena_t arena = newTable ? fsid_arena_create(_fsid, size) : NULL;
+
+    if (!arena)
+    {
+        if (newTable)
+            fsid_table_destroy(_fsid, newTable);
+
+        return FSID_ERR_OUT_OF_MEMORY;
+    }
+
+    for (size_t index = 0; index < table->capacity; ++index)
+    {
+        if (fsid_table_full(table->ctrl[index]))
+            fsid_table_put(newTable, &table->slots[index], fsid_slot_hash(_fsid, &table->slots[index]));
+    }
+
+    char* memory = arena->data;
+
+    /* New table is not published yet, its record slots are repointed in place */
+    for (size_t index = 0; index < newTable->capacity; ++index)
+    {
+        if (!fsid_table_full(newTable->ctrl[index]))
+            continue;
+
+        const fsid_slot_t slot = &newTable->slots[index];
+        const fsid_record_t record = _fsid->values->records[slot->value];
+        const fsid_record_t copy = fsid_record_move(_fsid, record, slot->value, memory);
+
+        memory += fsid_record_size(_fsid, record);
+
+        if (slot->length == 0)
+            memcpy(slot->key, &copy, sizeof(copy));
+    }
+
+    FSID_STORE_RELEASE(&_fsid->table, newTable);
+
+    if (fsid_readers_unlocked(_fsid))
+    {
+        newTable->retired = table;
+        table->epoch = fsid_epoch_advance(_fsid);
+    }
+    else
+    {
+        fsid_table_destroy(_fsid, table);
+    }
+
+    fsid_compact_arena(_fsid, arena, size, _retire);
+    return FSID_SUCCESSFUL;
+}
+
+/* Rebuild index of broker, old memory is kept until release if strings are accessed without lock */
+static int fsid_compact_safe(fsid_t _fsid)
+{
+    if (_fsid->engine == FSID_ENGINE_HASHTABLE)
+        return fsid_compact_table(_fsid, fsid_epoch_used(_fsid));
+
+    return fsid_compact_tree(_fsid, fsid_epoch_used(_fsid));
+}
+
+/* Lock broker and its shards against writers, even if readers take no lock, shards are always locked in the same order */
+static void fsid_snapshot_lock(fsid_t _fsid)
+{
+    for (uint32_t index = 0; index < (1u << _fsid->shardBits); ++index)
+    {
+        const fsid_t broker = fsid_shard(_fsid, index);
+
+        if (broker->flags & FSID_FLAG_LOCKFREE_READERS)
+            fsid_exclusive_lock(broker);
+        else
+            fsid_rolock_func(broker);
+    }
+}
+
+static void fsid_snapshot_unlock(fsid_t _fsid)
+{
+    for (uint32_t index = 1u << _fsid->shardBits; index > 0; --index)
+    {
+        const fsid_t broker = fsid_shard(_fsid, index - 1);
+
+        if (broker->flags & FSID_FLAG_LOCKFREE_READERS)
+            fsid_exclusive_unlock(broker);
+        else
+            fsid_rounlock_func(broker);
+    }
+}
+
+/* Size of frozen image section rounded up to 8 bytes */
+static inline uint64_t fsid_frozen_align(uint64_t _size)
+{
+    return (_size + 7) & ~(uint64_t)7;
+}
+
+static inline bool fsid_frozen_taken(const fsid_frozen_build_t _build, uint64_t _position)
+{
+    return (_build->taken[_position / 64] >> (_position % 64)) & 1;
+}
+
+/* Search pilots of all buckets for one seed, larger buckets are placed first while the table is empty */
+static bool fsid_frozen_pilots(fsid_frozen_build_t _build, uint64_t _seed)
+{
+    uint32_t sizes[FSID_FROZEN_MAX_BUCKET + 2] = { 0 };
+    const uint64_t bucketsCount = _build->bucketsCount;
+
+    memset(_build->offsets, 0, sizeof(uint32_t) * (bucketsCount + 1));
+
+    for (size_t index = 0; index < _build->count; ++index)
+    {
+        const fsid_record_t record = _build->keys[index].record;
+
+        _build->keys[index].hash = fsid_hash_seeded(fsid_record_data(record), fsid_record_length(record), _seed);
+        _build->offsets[fsid_frozen_bucket(_build->keys[index].hash, bucketsCount) + 1]++;
+    }
+
+    for (uint64_t bucket = 0; bucket < bucketsCount; ++bucket)
+    {
+        const uint32_t size = _build->offsets[bucket + 1];
+
+        if (size > FSID_FROZEN_MAX_BUCKET)
+            return false;
+
+        sizes[FSID_FROZEN_MAX_BUCKET - size + 1]++;
+        _build->offsets[bucket + 1] += _build->offsets[bucket];
+        _build->buckets[bucket] = _build->offsets[bucket];
+    }
+
+    /* Keys grouped by bucket, buckets is the fill cursor */
+    for (size_t index = 0; index < _build->count; ++index)
+        _build->order[_build->buckets[fsid_frozen_bucket(_build->keys[index].hash, bucketsCount)]++] = (uint32_t)index;
+
+    /* Buckets by decreasing size */
+    for (int size = 1; size <= FSID_FROZEN_MAX_BUCKET + 1; ++size)
+        sizes[size] += sizes[size - 1];
+
+    for (uint64_t bucket = 0; bucket < bucketsCount; ++bucket)
+        _build->buckets[sizes[FSID_FROZEN_MAX_BUCKET - (_build->offsets[bucket + 1] - _build->offsets[bucket])]++] = (uint32_t)bucket;
+
+    memset(_build->taken, 0, sizeof(uint64_t) * (size_t)((_build->tableSize + 63) / 64));
+
+    for (uint64_t index = 0; index < bucketsCount; ++index)
+    {
+        const uint32_t bucket = _build->buckets[index];
+        const uint32_t begin = _build->offsets[bucket];
+        const uint32_t end = _build->offsets[bucket + 1];
+        uint32_t pilot = 0;
+
+        if (begin == end)
+            break;
+
+        /* Keys with equal hashes never separate, new seed is required */
+        for (uint32_t key = begin + 1; key < end; ++key)
+        {
+            for (uint32_t other = begin; other < key; ++other)
+            {
+                if (_build->keys[_build->order[key]].hash == _build->keys[_build->order[other]].hash)
+                    return false;
+            }
+        }
+
+        for (;; ++pilot)
+        {
+            uint32_t key = begin;
+
+            if (pilot > FSID_FROZEN_MAX_PILOT)
+                return false;
+
+            for (; key < end; ++key)
+            {
+                fsid_frozen_key_t current = &_build->keys[_build->order[key]];
+                const uint64_t position = fsid_frozen_position(current->hash, pilot, _build->tableSize);
+                uint32_t other = begin;
+
+                if (fsid_frozen_taken(_build, position))
+                    break;
+
+                while (other < key && _build->keys[_build->order[other]].position != position)
+                    other++;
+
+                if (other < key)
+                    break;
+
+                current->position = (uint32_t)position;
+            }
+
+            if (key == end)
+                break;
+        }
+
+        for (uint32_t key = begin; key < end; ++key)
+        {
+            const uint32_t position = _build->keys[_build->order[key]].position;
+
+            _build->taken[position / 64] |= (uint64_t)1 << (position % 64);
+        }
+
+        _build->pilots[bucket] = (uint16_t)pilot;
+    }
+    return true;
+}
+
+/* Build and write frozen image: header, pilots, entries, remap, value table and strings */
+static int fsid_freeze_safe(fsid_t _fsid, fsid_writer_t _writer)
+{
+    const uint32_t shardsCount = 1u << _fsid->shardBits;
+    size_t count = 0;
+    uint64_t blobSize = 0;
+    int maxValue = FSID_EMPTY_STRING_VALUE;
+    /* Value table is indexed without generations of bounded broker, a slot per local value and shard */
+    const uint32_t generationBits = _fsid->generationBits;
+    const uint32_t generationShift = generationBits ? _fsid->shardBits : 0;
+
+    for (uint32_t shard = 0; shard < shardsCount; ++shard)
+    {
+        const fsid_t broker = fsid_shard(_fsid, shard);
+
+        for (int value = FSID_EMPTY_STRING_VALUE + 1; value < broker->nextValue; ++value)
+        {
+            const fsid_record_t record = fsid_value_record(broker, value);
+
+            if (!record)
+                continue;
+
+            if ((uint64_t)fsid_record_length(record) >= UINT32_MAX)
+                return FSID_ERR_INVALID_PARAM;
+
+            const int publicValue = fsid_public_value(broker, value);
+
+            if (publicValue > maxValue)
+                maxValue = publicValue;
+
+            count++;
+            blobSize += fsid_record_length(record) + 1;
+        }
+    }
+
+    struct fsid_frozen_build_struct build;
+
+    build.count = count;
+    build.tableSize = count ? count + count / 99 + 1 : 0;
+    build.bucketsCount = count ? count / FSID_FROZEN_BUCKET_KEYS + 2 : 0;
+
+    const uint64_t valuesCount = fsid_frozen_slot(maxValue, generationBits, generationShift) + 1;
+    const uint64_t remapCount = build.tableSize - count;
+    const uint64_t keysSize = sizeof(struct fsid_frozen_key_struct) * (uint64_t)count;
+    const uint64_t pilotsSize = fsid_frozen_align(sizeof(uint16_t) * build.bucketsCount);
+    const uint64_t offsetsSize = fsid_frozen_align(sizeof(uint32_t) * (build.bucketsCount + 1));
+    const uint64_t orderSize = fsid_frozen_align(sizeof(uint32_t) * (uint64_t)count);
+    const uint64_t bucketsSize = fsid_frozen_align(sizeof(uint32_t) * build.bucketsCount);
+    const uint64_t takenSize = sizeof(uint64_t) * ((build.tableSize + 63) / 64);
+    const uint64_t remapSize = fsid_frozen_align(sizeof(uint32_t) * remapCount);
+    const uint64_t valuesSize = fsid_frozen_align(sizeof(uint32_t) * valuesCount);
+    const uint64_t totalSize = keysSize + pilotsSize + offsetsSize + orderSize + bucketsSize + takenSize + remapSize + valuesSize;
+
+    if (totalSize > SIZE_MAX)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    uint8_t* memory = (uint8_t*)fsid_alloc_func(_fsid, (size_t)totalSize);
+
+    if (!memory)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    build.keys = (fsid_frozen_key_t)memory;
+    build.pilots = (uint16_t*)(memory + keysSize);
+    build.offsets = (uint32_t*)((uint8_t*)build.pilots + pilotsSize);
+    build.order = (uint32_t*)((uint8_t*)build.offsets + offsetsSize);
+    build.buckets = (uint32_t*)((uint8_t*)build.order + orderSize);
+    build.taken = (uint64_t*)((uint8_t*)build.buckets + bucketsSize);
+
+    uint32_t* remap = (uint32_t*)((uint8_t*)build.taken + takenSize);
+    uint32_t* values = (uint32_t*)((uint8_t*)remap + remapSize);
+    size_t index = 0;
+
+    memset(build.pilots, 0, (size_t)pilotsSize);
+    memset(remap, 0, (size_t)remapSize);
+    memset(values, 0, (size_t)valuesSize);
+
+    for (uint32_t shard = 0; shard < shardsCount; ++shard)
+    {
+        const fsid_t broker = fsid_shard(_fsid, shard);
+
+        for (int value = FSID_EMPTY_STRING_VALUE + 1; value < broker->nextValue; ++value)
+        {
+            const fsid_record_t record = fsid_value_record(broker, value);
+
+            if (record)
+            {
+                build.keys[index].record = record;
+                build.keys[index++].value = fsid_public_value(broker, value);
+            }
+        }
+    }
+
+    uint64_t seed = FSID_HASH_SEED;
+    int attempt = 0;
+
+    while (count && !fsid_frozen_pilots(&build, seed))
+    {
+        if (++attempt == FSID_FROZEN_MAX_SEEDS)
+        {
+            fsid_free_func(_fsid, memory, (size_t)totalSize);
+            return FSID_ERR_HASH_FAILED;
+        }
+
+        seed += FSID_HASH_PRIME64;
+    }
+
+    /* Positions past the keys are remapped to free positions, order receives key of each final position */
+    uint64_t slot = 0;
+
+    for (uint64_t position = count; position < build.tableSize; ++position)
+    {
+        if (!fsid_frozen_taken(&build, position))
+            continue;
+
+        while (fsid_frozen_taken(&build, slot))
+            slot++;
+
+        remap[position - count] = (uint32_t)slot++;
+    }
+
+    for (index = 0; index < count; ++index)
+    {
+        const uint32_t position = build.keys[index].position;
+        const uint32_t entry = position < count ? position : remap[position - count];
+
+        build.order[entry] = (uint32_t)index;
+        values[fsid_frozen_slot(build.keys[index].value, generationBits, generationShift)] = entry + 1;
+    }
+
+    uint8_t header[FSID_FROZEN_HEADER_SIZE] = { 0 };
+    const uint8_t padding[8] = { 0 };
+
+    fsid_write32(header, FSID_FROZEN_MAGIC);
+    fsid_write32(header + 4, FSID_FROZEN_VERSION);
+    fsid_write64(header + 8, seed);
+    fsid_write64(header + 16, count);
+    fsid_write64(header + 24, build.tableSize);
+    fsid_write64(header + 32, build.bucketsCount);
+    fsid_write64(header + 40, valuesCount);
+    fsid_write64(header + 48, blobSize);
+    fsid_write32(header + 56, generationBits);
+    fsid_write32(header + 60, generationShift);
+    fsid_writer_data(_writer, header, sizeof(header));
+
+    for (uint64_t bucket = 0; bucket < build.bucketsCount; ++bucket)
+    {
+        const uint8_t pilot[2] = { (uint8_t)build.pilots[bucket], (uint8_t)(build.pilots[bucket] >> 8) };
+
+        fsid_writer_data(_writer, pilot, sizeof(pilot));
+    }
+
+    fsid_writer_data(_writer, padding, (size_t)(pilotsSize - sizeof(uint16_t) * build.bucketsCount));
+
+    uint64_t offset = 0;
+
+    for (index = 0; index < count; ++index)
+    {
+        const fsid_frozen_key_t key = &build.keys[build.order[index]];
+        uint8_t entry[FSID_FROZEN_ENTRY_SIZE];
+
+        fsid_write64(entry, offset);
+        fsid_write64(entry + 8, key->hash);
+        fsid_write32(entry + 16, (uint32_t)fsid_record_length(key->record));
+        fsid_write32(entry + 20, (uint32_t)key->value);
+        fsid_writer_data(_writer, entry, sizeof(entry));
+        offset += fsid_record_length(key->record) + 1;
+    }
+
+    for (uint64_t position = 0; position < remapCount; ++position)
+        fsid_writer_u32(_writer, remap[position]);
+
+    fsid_writer_data(_writer, padding, (size_t)(remapSize - sizeof(uint32_t) * remapCount));
+
+    for (uint64_t value = 0; value < valuesCount; ++value)
+        fsid_writer_u32(_writer, values[value]);
+
+    fsid_writer_data(_writer, padding, (size_t)(valuesSize - sizeof(uint32_t) * valuesCount));
+
+    /* Strings in entry order with terminating zero */
+    for (index = 0; index < count; ++index)
+    {
+        const fsid_record_t record = build.keys[build.order[index]].record;
+
+        fsid_writer_data(_writer, fsid_record_data(record), fsid_record_length(record));
+        fsid_writer_data(_writer, padding, 1);
+    }
+
+    fsid_writer_flush(_writer);
+    fsid_free_func(_fsid, memory, (size_t)totalSize);
+    return FSID_SUCCESSFUL;
+}
+
+/* Create empty read-only broker, image is attached by fsid_frozen_parse */
+static int fsid_frozen_create(fsid_t* _fsid, const fsid_init_t* _params, uint32_t _flags)
+{
+    fsid_init_t params;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = _flags;
+
+    if (_params)
+    {
+        params.userData = _params->userData;
+        params.allocFunc = _params->allocFunc;
+        params.freeFunc = _params->freeFunc;
+    }
+
+    int result = fsid_initialize(_fsid, &params);
+
+    if (result != FSID_SUCCESSFUL)
+        return result;
+
+    fsid_t fsid = *_fsid;
+
+    fsid->frozen = (fsid_frozen_t)fsid_alloc_func(fsid, sizeof(struct fsid_frozen_struct));
+
+    if (!fsid->frozen)
+    {
+        fsid_release(fsid);
+        *_fsid = NULL;
+        return FSID_ERR_OUT_OF_MEMORY;
+    }
+
+    memset(fsid->frozen, 0, sizeof(struct fsid_frozen_struct));
+    fsid->engine = FSID_ENGINE_FROZEN;
+    return FSID_SUCCESSFUL;
+}
+
+/* Validate frozen image and attach it to read-only broker, sections are checked lazily by lookups */
+static int fsid_frozen_parse(fsid_t _fsid, const uint8_t* _data, size_t _size)
+{
+    fsid_frozen_t frozen = _fsid->frozen;
+
+    if (_size < FSID_FROZEN_HEADER_SIZE || fsid_read32(_data) != FSID_FROZEN_MAGIC)
+        return FSID_ERR_INVALID_FORMAT;
+
+    /* Images of version 1 index the value table by whole values and have zeros in place of generation fields */
+    const uint32_t version = fsid_read32(_data + 4);
+    const uint32_t generationBits = fsid_read32(_data + 56);
+    const uint32_t generationShift = fsid_read32(_data + 60);
+
+    if (version == 0 || version > FSID_FROZEN_VERSION || (version == 1 && (generationBits || generationShift)))
+        return FSID_ERR_INVALID_FORMAT;
+
+    if ((generationBits != 0 && generationBits != FSID_GENERATION_BITS) || generationShift > (generationBits ? FSID_SHARD_MAX_BITS : 0))
+        return FSID_ERR_INVALID_FORMAT;
+
+    const uint64_t count = fsid_read64(_data + 16);
+    const uint64_t tableSize = fsid_read64(_data + 24);
+    const uint64_t bucketsCount = fsid_read64(_data + 32);
+    const uint64_t valuesCount = fsid_read64(_data + 40);
+    const uint64_t blobSize = fsid_read64(_data + 48);
+
+    if (count > INT_MAX || tableSize < count || tableSize > UINT32_MAX || valuesCount == 0 || valuesCount > (uint64_t)INT_MAX + 1)
+        return FSID_ERR_INVALID_FORMAT;
+
+    if ((count && bucketsCount < 2) || bucketsCount > count + 2)
+        return FSID_ERR_INVALID_FORMAT;
+
+    const uint64_t entries = FSID_FROZEN_HEADER_SIZE + fsid_frozen_align(sizeof(uint16_t) * bucketsCount);
+    const uint64_t remap = entries + FSID_FROZEN_ENTRY_SIZE * count;
+    const uint64_t values = remap + fsid_frozen_align(sizeof(uint32_t) * (tableSize - count));
+    const uint64_t strings = values + fsid_frozen_align(sizeof(uint32_t) * valuesCount);
+
+    if (strings > _size || blobSize != _size - strings)
+        return FSID_ERR_INVALID_FORMAT;
+
+    frozen->pilots = _data + FSID_FROZEN_HEADER_SIZE;
+    frozen->entries = _data + entries;
+    frozen->remap = _data + remap;
+    frozen->values = _data + values;
+    frozen->strings = (const char*)(_data + strings);
+    frozen->count = count;
+    frozen->tableSize = tableSize;
+    frozen->bucketsCount = bucketsCount;
+    frozen->valuesCount = valuesCount;
+    frozen->blobSize = blobSize;
+    frozen->generationBits = generationBits;
+    frozen->generationShift = generationShift;
+    _fsid->hashSeed = fsid_read64(_data + 8);
+    return FSID_SUCCESSFUL;
+}
+
+/* Map frozen image file into read-only broker */
+static int fsid_frozen_map(fsid_t _fsid, const char* _path)
+{
+    fsid_frozen_t frozen = _fsid->frozen;
+
+#if defined(FSID_MMAP_WIN32)
+    HANDLE file = CreateFileA(_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+
+    if (file == INVALID_HANDLE_VALUE)
+        return FSID_ERR_IO;
+
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 || (uint64_t)size.QuadPart > SIZE_MAX)
+    {
+        CloseHandle(file);
+        return FSID_ERR_IO;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    CloseHandle(file);
+
+    if (!mapping)
+        return FSID_ERR_IO;
+
+    /* View keeps the mapping alive */
+    frozen->mapping = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (!frozen->mapping)
+        return FSID_ERR_IO;
+
+    frozen->mappingSize = (size_t)size.QuadPart;
+#elif defined(FSID_MMAP_POSIX)
+    const int file = open(_path, O_RDONLY);
+    struct stat info;
+
+    if (file < 0)
+        return FSID_ERR_IO;
+
+    if (fstat(file, &info) != 0 || info.st_size <= 0 || (uint64_t)info.st_size > SIZE_MAX)
+    {
+        close(file);
+        return FSID_ERR_IO;
+    }
+
+    void* mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+
+    close(file);
+
+    if (mapping == MAP_FAILED)
+        return FSID_ERR_IO;
+
+    frozen->mapping = mapping;
+    frozen->mappingSize = (size_t)info.st_size;
+#else
+    FILE* file = fopen(_path, "rb");
+    long size = 0;
+
+    if (!file)
+        return FSID_ERR_IO;
+
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) <= 0 || fseek(file, 0, SEEK_SET) != 0)
+    {
+        fclose(file);
+        return FSID_ERR_IO;
+    }
+
+    frozen->mapping = fsid_alloc_func(_fsid, (size_t)size);
+
+    if (!frozen->mapping)
+    {
+        fclose(file);
+        return FSID_ERR_OUT_OF_MEMORY;
+    }
+
+    frozen->mappingSize = (size_t)size;
+
+    if (fread(frozen->mapping, 1, (size_t)size, file) != (size_t)size)
+    {
+        fclose(file);
+        return FSID_ERR_IO;
+    }
+
+    fclose(file);
+#endif
+    return FSID_SUCCESSFUL;
+}
+
+/* Unmap frozen image file */
+static void fsid_frozen_unmap(fsid_t _fsid)
+{
+    fsid_frozen_t frozen = _fsid->frozen;
+
+#if defined(FSID_MMAP_WIN32)
+    UnmapViewOfFile(frozen->mapping);
+#elif defined(FSID_MMAP_POSIX)
+    munmap(frozen->mapping, frozen->mappingSize);
+#else
+    fsid_free_func(_fsid, frozen->mapping, frozen->mappingSize);
+#endif
+    frozen->mapping = NULL;
+}
+
+/* Write callback appending frozen image to memory of replica, capacity grows geometrically */
+static size_t FSID_CALLBACK fsid_write_image(void* _userData, const void* _data, size_t _size)
+{
+    fsid_image_writer_t writer = (fsid_image_writer_t)_userData;
+
+    if (_size > writer->capacity - writer->size)
+    {
+        size_t capacity = writer->capacity ? writer->capacity : FSID_IMAGE_BUFFER_SIZE;
+
+        while (capacity - writer->size < _size)
+        {
+            if (capacity > SIZE_MAX / 2)
+                return 0;
+
+            capacity *= 2;
+        }
+
+        uint8_t* data = (uint8_t*)fsid_alloc_func(writer->fsid, capacity);
+
+        if (!data)
+            return 0;
+
+        if (writer->data)
+        {
+            memcpy(data, writer->data, writer->size);
+            fsid_free_func(writer->fsid, writer->data, writer->capacity);
+        }
+
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+
+    memcpy(writer->data + writer->size, _data, _size);
+    writer->size += _size;
+    return _size;
+}
+
+/* Version of broker contents summed over shards, it changes with each insert and removal of a string */
+static uint64_t fsid_contents_version(const fsid_t _fsid)
+{
+    uint64_t version = FSID_LOAD_RELAXED(&_fsid->version);
+
+    if (_fsid->shards)
+    {
+        for (uint32_t index = 0; index < (1u << _fsid->shardBits); ++index)
+            version += FSID_LOAD_RELAXED(&_fsid->shards[index]->version);
+    }
+
+    return version;
+}
+
+/* Fill read-only broker with frozen image of source broker, the image is owned by the broker */
+static int fsid_replica_fill(fsid_t _fsid, fsid_t _source)
+{
+    struct fsid_image_writer_struct writer = { _fsid, NULL, 0, 0 };
+
+    /* Changes racing with the image only cause an extra refresh */
+    const uint64_t version = fsid_contents_version(_source);
+    int result = fsid_freeze(_source, &fsid_write_image, &writer);
+
+    /* Slack of the last growth is given back, the replica lives long */
+    if (result == FSID_SUCCESSFUL && writer.size < writer.capacity)
+    {
+        uint8_t* data = (uint8_t*)fsid_alloc_func(_fsid, writer.size);
+
+        if (data)
+        {
+            memcpy(data, writer.data, writer.size);
+            fsid_free_func(_fsid, writer.data, writer.capacity);
+            writer.data = data;
+            writer.capacity = writer.size;
+        }
+    }
+
+    _fsid->frozen->image = writer.data;
+    _fsid->frozen->imageSize = writer.capacity;
+    _fsid->frozen->sourceSerial = _source->serial;
+    _fsid->frozen->sourceVersion = version;
+
+    /* Writes into memory fail only if it runs out */
+    if (result == FSID_ERR_IO)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    if (result != FSID_SUCCESSFUL)
+        return result;
+
+    return fsid_frozen_parse(_fsid, writer.data, writer.size);
+}
+
+/* Fill empty broker from snapshot image */
+static int fsid_load_safe(fsid_t _fsid, fsid_read _readFunc, void* _userData)
+{
+    uint8_t header[FSID_IMAGE_HEADER_SIZE];
+
+    if (!fsid_read_data(_readFunc, _userData, header, sizeof(header)))
+        return FSID_ERR_IO;
+
+    if (fsid_read32(header) != FSID_IMAGE_MAGIC || fsid_read32(header + 4) != FSID_IMAGE_VERSION)
+        return FSID_ERR_INVALID_FORMAT;
+
+    /* Values of bounded brokers are tagged with generations */
+    if (fsid_read32(header + 12) != _fsid->generationBits)
+        return FSID_ERR_INVALID_FORMAT;
+
+    const uint64_t count = fsid_read64(header + 16);
+    const uint64_t blobSize = fsid_read64(header + 24);
+    const size_t entrySize = sizeof(uint32_t) + sizeof(uint64_t) * 2;
+
+    if (count > INT_MAX || blobSize < count)
+        return FSID_ERR_INVALID_FORMAT;
+
+    if (count == 0)
+        return blobSize == 0 ? FSID_SUCCESSFUL : FSID_ERR_INVALID_FORMAT;
+
+    if (blobSize > SIZE_MAX || count > (SIZE_MAX - (size_t)blobSize) / entrySize)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    const size_t dataSize = (size_t)count * entrySize + (size_t)blobSize;
+    uint8_t* data = (uint8_t*)fsid_alloc_func(_fsid, dataSize);
+
+    if (!data)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    int result = FSID_ERR_IO;
+
+    if (fsid_read_data(_readFunc, _userData, data, dataSize))
+    {
+        const bool rehash = fsid_read64(header + 32) != fsid_hash_func(_fsid, FSID_IMAGE_PROBE, sizeof(FSID_IMAGE_PROBE) - 1);
+
+        result = fsid_load_records(_fsid, data, (size_t)count, blobSize, rehash);
+    }
+
+    fsid_free_func(_fsid, data, dataSize);
+
+    for (uint32_t shard = 0; result == FSID_SUCCESSFUL && shard < (1u << _fsid->shardBits); ++shard)
+        result = fsid_load_index(fsid_shard(_fsid, shard));
+
+    return result;
+}
+
+/* Create broker from validated parameters */
+static fsid_t fsid_create(const struct fsid_struct* _params, void* _lockUserData)
+{
+    fsid_t fsid = (fsid_t)_params->allocFunc(_params->userData, sizeof(struct fsid_struct));
+
+    if (!fsid)
+        return NULL;
+
+    *fsid = *_params;
+    fsid->lockUserData = _lockUserData;
+    fsid->nextValue = FSID_EMPTY_STRING_VALUE + 1;
+    fsid->epoch = 1;
+    fsid->maxValue = INT_MAX >> (_params->shardBits + _params->generationBits);
+    fsid->serial = FSID_FETCH_ADD(&fsidSerial, 1) + 1;
+
+#ifdef FSID_STATISTICS
+    fsid->memorySize = sizeof(struct fsid_struct);
+    fsid->allocCount = 1;
+#endif /* FSID_STATISTICS */
+
+    return fsid;
+}
+
+/* Destroy broker */
+static void fsid_destroy(fsid_t _fsid)
+{
+    if (_fsid->shards)
+    {
+        for (uint32_t index = 0; index < (1u << _fsid->shardBits); ++index)
+        {
+            if (_fsid->shards[index])
+                fsid_destroy(_fsid->shards[index]);
+        }
+
+        fsid_free_func(_fsid, _fsid->shards, sizeof(fsid_t) << _fsid->shardBits);
+    }
+
+    fsid_thread_t thread = _fsid->threads;
+
+    while (thread)
+    {
+        fsid_thread_t next = thread->next;
+        fsid_free_func(_fsid, thread, fsid_thread_size(_fsid->threadCacheSize));
+        thread = next;
+    }
+
+    fsid_value_table_t values = _fsid->values;
+
+    while (values)
+    {
+        fsid_value_table_t retired = values->retired;
+        fsid_free_func(_fsid, values, fsid_value_table_size(_fsid, values->capacity));
+        values = retired;
+    }
+
+    fsid_arena_destroy_all(_fsid, _fsid->arena);
+    fsid_arena_destroy_all(_fsid, _fsid->retiredArena);
+
+    if (_fsid->freeValues)
+        fsid_free_func(_fsid, _fsid->freeValues, sizeof(int) * _fsid->freeValuesCapacity);
+
+    if (_fsid->limbo)
+        fsid_free_func(_fsid, _fsid->limbo, sizeof(struct fsid_limbo_struct) * _fsid->limboCapacity);
+
+#ifdef FSID_STATISTICS
+    _fsid->recordsCount = 0;
+#endif /* FSID_STATISTICS */
+
+    fsid_node_pool_destroy_all(_fsid, _fsid->pool);
+
+    fsid_table_t table = _fsid->table;
+
+    while (table)
+    {
+        fsid_table_t retired = table->retired;
+        fsid_table_destroy(_fsid, table);
+        table = retired;
+    }
+
+    if (_fsid->frozen)
+    {
+        if (_fsid->frozen->mapping)
+            fsid_frozen_unmap(_fsid);
+
+        if (_fsid->frozen->image)
+            fsid_free_func(_fsid, _fsid->frozen->image, _fsid->frozen->imageSize);
+
+        fsid_free_func(_fsid, _fsid->frozen, sizeof(struct fsid_frozen_struct));
+    }
+
+    void* userData = _fsid->userData;
+    fsid_free fFree = _fsid->freeFunc;
+
+    fFree(userData, _fsid);
+}
+
+/* Public methods */
+
+#ifdef FSID_STATISTICS
+/* Read statistics of one broker or shard, the broker is locked unless its readers take no lock */
+static void fsid_broker_statistics(fsid_statistics_t* _stat, const fsid_t _fsid)
+{
+    const bool frozen = _fsid->engine == FSID_ENGINE_FROZEN;
+
+    if (!frozen)
+        fsid_rolock_func(_fsid);
+
+    /* Table replaced meanwhile is retired until readers without lock leave the epoch */
+    const fsid_table_t table = FSID_LOAD_ACQUIRE(&_fsid->table);
+
+    _stat->memorySize = _fsid->memorySize;
+    _stat->arenaSlack = _fsid->arenaSize - _fsid->arenaUsed + _fsid->freeBytes;
+    _stat->hashesCount = _fsid->engine == FSID_ENGINE_HASHTABLE ? (table ? FSID_LOAD_RELAXED(&table->count) : 0) : _fsid->nodesCount;
+    _stat->valuesCount = _fsid->recordsCount;
+    _stat->indexDepth = table ? table->maxProbe : (size_t)(fsid_node_height(_fsid->root) + 1);
+    _stat->stringBytes = _fsid->stringBytes;
+    _stat->overheadBytes = _fsid->memorySize - _fsid->stringsStored;
+    _stat->arenaSize = _fsid->arenaSize;
+    _stat->nodesCapacity = _fsid->nodesCapacity;
+    _stat->tableCapacity = table ? table->capacity : 0;
+    _stat->allocCount = _fsid->allocCount;
+    _stat->evictions = _fsid->evictions;
+    _stat->hugePagesDenied = _fsid->hugePagesDenied;
+    memcpy(_stat->chainHistogram, table ? table->probeHistogram : _fsid->chainHistogram, sizeof(_stat->chainHistogram));
+
+    /* Frozen strings are in the image and each has its own slot */
+    if (frozen)
+    {
+        _stat->hashesCount = _stat->valuesCount = (size_t)_fsid->frozen->count;
+        _stat->stringBytes = (size_t)(_fsid->frozen->blobSize - _fsid->frozen->count);
+        _stat->indexDepth = _fsid->frozen->count ? 1 : 0;
+        _stat->chainHistogram[0] = (size_t)_fsid->frozen->count;
+    }
+
+    _stat->cacheHits = 0;
+    _stat->cacheMisses = 0;
+
+    for (fsid_thread_t thread = FSID_LOAD_ACQUIRE(&_fsid->threads); thread; thread = thread->next)
+    {
+        _stat->cacheHits += FSID_LOAD_RELAXED(&thread->cacheHits);
+        _stat->cacheMisses += FSID_LOAD_RELAXED(&thread->cacheMisses);
+    }
+
+    if (!frozen)
+        fsid_rounlock_func(_fsid);
+}
+
+int fsid_get_statistics(fsid_statistics_t* _stat, const fsid_t _fsid)
+{
+    if (!_stat)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    const bool epoch = _fsid->engine != FSID_ENGINE_FROZEN && fsid_readers_unlocked(_fsid);
+
+    if (epoch)
+        fsid_epoch_enter(_fsid, NULL);
+
+    fsid_broker_statistics(_stat, _fsid);
+
+    if (_fsid->shards)
+    {
+        for (uint32_t index = 0; index < (1u << _fsid->shardBits); ++index)
+        {
+            fsid_statistics_t stat;
+            fsid_broker_statistics(&stat, _fsid->shards[index]);
+
+            _stat->memorySize += stat.memorySize;
+            _stat->arenaSlack += stat.arenaSlack;
+            _stat->hashesCount += stat.hashesCount;
+            _stat->valuesCount += stat.valuesCount;
+            _stat->cacheHits += stat.cacheHits;
+            _stat->cacheMisses += stat.cacheMisses;
+            _stat->stringBytes += stat.stringBytes;
+            _stat->overheadBytes += stat.overheadBytes;
+            _stat->arenaSize += stat.arenaSize;
+            _stat->nodesCapacity += stat.nodesCapacity;
+            _stat->tableCapacity += stat.tableCapacity;
+            _stat->allocCount += stat.allocCount;
+            _stat->evictions += stat.evictions;
+            _stat->hugePagesDenied += stat.hugePagesDenied;
+
+            if (stat.indexDepth > _stat->indexDepth)
+                _stat->indexDepth = stat.indexDepth;
+
+            for (int bucket = 0; bucket < FSID_STATISTICS_CHAIN_BUCKETS; ++bucket)
+                _stat->chainHistogram[bucket] += stat.chainHistogram[bucket];
+        }
+    }
+
+    if (epoch)
+        fsid_epoch_leave(_fsid, NULL);
+
+    return FSID_SUCCESSFUL;
+}
+#endif /* FSID_STATISTICS */
+
+/**
+*/
+int fsid_initialize(fsid_t* _fsid, const fsid_init_t* _params)
+{
+    struct fsid_struct params;
+    void* const* shardUserData = NULL;
+    fsid_t fsid_internal = NULL;
+
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    memset(&params, 0, sizeof(params));
+
+    params.allocFunc = &fsid_alloc_default;
+    params.freeFunc = &fsid_free_default;
+    params.hashSeed = FSID_HASH_SEED;
+    params.rolockFunc = &fsid_lock_default;
+    params.rounlockFunc = &fsid_unlock_default;
+    params.rwlockFunc = &fsid_lock_default;
+    params.rwunlockFunc = &fsid_unlock_default;
+    params.engine = FSID_ENGINE_TREE;
+    params.arenaChunkSize = FSID_ARENA_CHUNK_SIZE;
+    params.arenaAlignment = FSID_ARENA_ALIGNMENT;
+    params.sampleInterval = FSID_SAMPLE_INTERVAL;
+
+    if (_params)
+    {
+        params.userData = _params->userData;
+
+        if (_params->allocFunc && _params->freeFunc)
+        {
+            params.allocFunc = _params->allocFunc;
+            params.freeFunc = _params->freeFunc;
+        }
+        else if (_params->allocFunc || _params->freeFunc)
+        {
+            return FSID_ERR_INVALID_PARAM;
+        }
+
+        if (_params->rwlockFunc && _params->rwunlockFunc)
+        {
+            params.rwlockFunc = _params->rwlockFunc;
+            params.rwunlockFunc = _params->rwunlockFunc;
+        }
+        else if (_params->rwlockFunc || _params->rwunlockFunc)
+        {
+            return FSID_ERR_INVALID_PARAM;
+        }
+
+        if (_params->rolockFunc && _params->rounlockFunc)
+        {
+            params.rolockFunc = _params->rolockFunc;
+            params.rounlockFunc = _params->rounlockFunc;
+        }
+        else if (!_params->rolockFunc && !_params->rounlockFunc)
+        {
+            params.rolockFunc = params.rwlockFunc;
+            params.rounlockFunc = params.rwunlockFunc;
+        }
+        else
+        {
+            return FSID_ERR_INVALID_PARAM;
+        }
+
+        if (_params->hash64Func)
+        {
+            params.hash64Func = _params->hash64Func;
+        }
+        else if (_params->hashFunc)
+        {
+            params.hashFunc = _params->hashFunc;
+        }
+
+        if (_params->engine != FSID_ENGINE_TREE && _params->engine != FSID_ENGINE_HASHTABLE)
+            return FSID_ERR_INVALID_PARAM;
+
+        params.engine = _params->engine;
+        params.flags = _params->flags;
+
+        if (params.flags & ~(uint32_t)(FSID_FLAG_LOCKFREE_READERS | FSID_FLAG_EXTERNAL_LOCKING | FSID_FLAG_LOCKFREE_WRITERS | FSID_FLAG_OPTIMISTIC_READERS | FSID_FLAG_HUGE_PAGES))
+            return FSID_ERR_INVALID_PARAM;
+
+        /* Optimistic readers rely on the read-write lock of writers and don't mark strings checked */
+        if ((params.flags & FSID_FLAG_OPTIMISTIC_READERS) && ((params.flags & (FSID_FLAG_LOCKFREE_READERS | FSID_FLAG_EXTERNAL_LOCKING | FSID_FLAG_LOCKFREE_WRITERS)) || _params->maxEntries || _params->maxBytes))
+            return FSID_ERR_INVALID_PARAM;
+
+#ifndef FSID_HUGE_PAGES
+        if (params.flags & FSID_FLAG_HUGE_PAGES)
+            return FSID_ERR_INVALID_PARAM;
+#endif /* FSID_HUGE_PAGES */
+
+        /* Inserts without lock can't be serialized by the caller or evict, their readers take no lock either */
+        if (params.flags & FSID_FLAG_LOCKFREE_WRITERS)
+        {
+            if ((params.flags & FSID_FLAG_EXTERNAL_LOCKING) || _params->maxEntries || _params->maxBytes)
+                return FSID_ERR_INVALID_PARAM;
+
+            params.flags |= FSID_FLAG_LOCKFREE_READERS;
+        }
+
+#ifdef FSID_ATOMICS
+        /* Tree rotations modify nodes in place, readers without lock need the hash table */
+        if ((params.flags & (FSID_FLAG_LOCKFREE_READERS | FSID_FLAG_OPTIMISTIC_READERS)) && params.engine != FSID_ENGINE_HASHTABLE)
+            return FSID_ERR_INVALID_PARAM;
+#else
+        if (params.flags & (FSID_FLAG_LOCKFREE_READERS | FSID_FLAG_OPTIMISTIC_READERS))
+            return FSID_ERR_INVALID_PARAM;
+#endif /* FSID_ATOMICS */
+
+        if (_params->arenaChunkSize)
+            params.arenaChunkSize = _params->arenaChunkSize;
+
+        if (_params->arenaAlignment)
+        {
+            if (_params->arenaAlignment & (_params->arenaAlignment - 1))
+                return FSID_ERR_INVALID_PARAM;
+
+            if (_params->arenaAlignment > params.arenaAlignment)
+                params.arenaAlignment = _params->arenaAlignment;
+        }
+
+        /* String arena chunk with its header fills one huge page unless the chunk size is given */
+        const size_t arenaReserve = sizeof(struct fsid_arena_struct) + params.arenaAlignment - 1;
+
+        if ((params.flags & FSID_FLAG_HUGE_PAGES) && !_params->arenaChunkSize && arenaReserve < FSID_HUGE_PAGE_SIZE / 2)
+            params.arenaChunkSize = FSID_HUGE_PAGE_SIZE - arenaReserve;
+
+        if (_params->shardBits > FSID_SHARD_MAX_BITS)
+            return FSID_ERR_INVALID_PARAM;
+
+        params.shardBits = _params->shardBits;
+        shardUserData = _params->shardUserData;
+
+        if (_params->threadCacheSize > FSID_THREAD_CACHE_MAX_SIZE)
+            return FSID_ERR_INVALID_PARAM;
+
+#if !defined(FSID_THREAD_LOCAL) || !defined(FSID_ATOMICS)
+        if (_params->threadCacheSize)
+            return FSID_ERR_INVALID_PARAM;
+#endif /* FSID_THREAD_LOCAL && FSID_ATOMICS */
+
+#ifndef FSID_INSTRUMENTED
+        if (_params->sampleFunc)
+            return FSID_ERR_INVALID_PARAM;
+#endif /* FSID_INSTRUMENTED */
+
+        params.sampleFunc = _params->sampleFunc;
+        params.sampleInterval = _params->sampleInterval ? _params->sampleInterval : FSID_SAMPLE_INTERVAL;
+
+        if (_params->threadCacheSize)
+        {
+            params.threadCacheSize = 1;
+
+            while (params.threadCacheSize < _params->threadCacheSize)
+                params.threadCacheSize *= 2;
+        }
+
+        if (_params->maxEntries || _params->maxBytes)
+        {
+            params.maxEntries = _params->maxEntries;
+            params.maxBytes = _params->maxBytes;
+            params.generationBits = FSID_GENERATION_BITS;
+        }
+    }
+
+    fsid_internal = fsid_create(&params, params.userData);
+
+    if (!fsid_internal)
+        return FSID_ERR_OUT_OF_MEMORY;
+
+    if (params.shardBits > 0)
+    {
+        const uint32_t count = 1u << params.shardBits;
+
+        /* Lookup cache and sampling are in front of the shards, each shard evicts its own strings */
+        params.threadCacheSize = 0;
+        params.sampleFunc = NULL;
+        params.maxEntries = (params.maxEntries + count - 1) / count;
+        params.maxBytes = (params.maxBytes + count - 1) / count;
+
+        fsid_internal->shards = (fsid_t*)fsid_alloc_func(fsid_internal, sizeof(fsid_t) * count);
+
+        if (!fsid_internal->shards)
+        {
+            fsid_destroy(fsid_internal);
+            return FSID_ERR_OUT_OF_MEMORY;
+        }
+
+        memset(fsid_internal->shards, 0, sizeof(fsid_t) * count);
+
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            params.shardIndex = index;
+            fsid_internal->shards[index] = fsid_create(&params, shardUserData ? shardUserData[index] : params.userData);
+
+            if (!fsid_internal->shards[index])
+            {
+                fsid_destroy(fsid_internal);
+                return FSID_ERR_OUT_OF_MEMORY;
+            }
+
+            fsid_internal->shards[index]->parent = fsid_internal;
+        }
+    }
+
+    *_fsid = fsid_internal;
+    return FSID_SUCCESSFUL;
+}
+
+/**
+*/
+int fsid_release(fsid_t _fsid)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    fsid_destroy(_fsid);
+    return FSID_SUCCESSFUL;
+}
+
+/* Per-thread state of broker if lookup cache, readers without lock or instrumentation is enabled */
+static inline fsid_thread_t fsid_thread_cache(fsid_t _fsid)
+{
+#if defined(FSID_INSTRUMENTED)
+    return fsid_thread_get(_fsid);
+#elif defined(FSID_THREAD_LOCAL)
+    if (_fsid->threadCacheSize || fsid_readers_unlocked(_fsid))
+        return fsid_thread_get(_fsid);
+#endif /* FSID_INSTRUMENTED */
+
+    return NULL;
+}
+
+#ifdef FSID_INSTRUMENTED
+/* Monotonic clock in nanoseconds */
+static uint64_t fsid_clock(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+/* Start of operation, returns start time if the operation is sampled, otherwise 0 */
+static inline uint64_t fsid_sample_start(const fsid_t _fsid, fsid_thread_t _thread)
+{
+    fsidProbeSteps = 0;
+
+    if (!_thread || !_fsid->sampleFunc || --_thread->sampleCountdown)
+        return 0;
+
+    _thread->sampleCountdown = _fsid->sampleInterval;
+    return fsid_clock();
+}
+
+/* Count completed operations of the calling thread and report sampled latency */
+static void fsid_sample_end(const fsid_t _fsid, fsid_thread_t _thread, int _operation, uint64_t _count, uint64_t _misses, uint64_t _start, uint64_t _locked)
+{
+    if (!_thread)
+        return;
+
+    if (_operation == FSID_OPERATION_CHECK)
+    {
+        FSID_STORE_RELAXED(&_thread->checks, _thread->checks + _count);
+        FSID_STORE_RELAXED(&_thread->checkMisses, _thread->checkMisses + _misses);
+    }
+    else
+    {
+        FSID_STORE_RELAXED(&_thread->inserts, _thread->inserts + _count);
+    }
+
+    FSID_STORE_RELAXED(&_thread->probeSteps, _thread->probeSteps + fsidProbeSteps);
+
+    if (_start)
+    {
+        const uint64_t now = fsid_clock();
+
+        FSID_STORE_RELAXED(&_thread->samples, _thread->samples + 1);
+        FSID_STORE_RELAXED(&_thread->sampleNanoseconds, _thread->sampleNanoseconds + (now - _start));
+        FSID_STORE_RELAXED(&_thread->lockNanoseconds, _thread->lockNanoseconds + (_locked - _start));
+        _fsid->sampleFunc(_fsid->userData, _operation, now - _start, _locked - _start);
+    }
+}
+#endif /* FSID_INSTRUMENTED */
+
+/* Check string without lock, the lookup is repeated until no writer changed broker meanwhile, record of found string is read along */
+static int fsid_check_optimistic(const fsid_t _fsid, const char* _string, size_t _length, const uint64_t _hash, fsid_record_t* _record)
+{
+    for (;;)
+    {
+        const uint32_t sequence = fsid_read_begin(_fsid);
+        const int value = fsid_check_stringlen_safe(_fsid, _string, _length, _hash);
+        const fsid_record_t record = _record && value > 0 ? fsid_value_record(_fsid, value) : NULL;
+
+        if (fsid_read_valid(_fsid, sequence))
+        {
+            if (_record)
+                *_record = record;
+
+            return value;
+        }
+    }
+}
+
+/* Check string with computed hash */
+static int fsid_check_hash(const fsid_t _fsid, const char* _string, size_t _length, const uint64_t _hash)
+{
+    fsid_thread_t thread = fsid_thread_cache(_fsid);
+    const bool epoch = fsid_epoch_used(_fsid);
+
+#ifdef FSID_INSTRUMENTED
+    const uint64_t start = fsid_sample_start(_fsid, thread);
+#endif /* FSID_INSTRUMENTED */
+
+    if (epoch)
+        fsid_epoch_enter(_fsid, thread);
+
+    if (thread && _fsid->threadCacheSize)
+    {
+        const int value = fsid_thread_check(thread, _string, _length, _hash);
+
+        if (value >= 0)
+        {
+            fsid_epoch_leave(_fsid, thread);
+
+#ifdef FSID_INSTRUMENTED
+            fsid_sample_end(_fsid, thread, FSID_OPERATION_CHECK, 1, 0, start, start);
+#endif /* FSID_INSTRUMENTED */
+            return value;
+        }
+    }
+
+    fsid_t broker = fsid_route_hash(_fsid, _hash);
+    const bool optimistic = (broker->flags & FSID_FLAG_OPTIMISTIC_READERS) != 0;
+    fsid_record_t record = NULL;
+    int value;
+
+    if (!optimistic)
+        fsid_rolock_func(broker);
+
+#ifdef FSID_INSTRUMENTED
+    const uint64_t locked = start ? fsid_clock() : 0;
+#endif /* FSID_INSTRUMENTED */
+
+    if (optimistic)
+    {
+        value = fsid_check_optimistic(broker, _string, _length, _hash, thread && _fsid->threadCacheSize ? &record : NULL);
+    }
+    else
+    {
+        value = fsid_check_stringlen_safe(broker, _string, _length, _hash);
+
+        if (thread && _fsid->threadCacheSize && value > 0)
+            record = fsid_value_record(broker, value);
+    }
+
+    /* Generation of bounded broker is read while the value can't be reused */
+    const int result = fsid_public_reference(broker, value);
+
+    if (record)
+        fsid_thread_store(thread, record, result);
+
+    if (!optimistic)
+        fsid_rounlock_func(broker);
+
+    if (epoch)
+        fsid_epoch_leave(_fsid, thread);
+
+#ifdef FSID_INSTRUMENTED
+    fsid_sample_end(_fsid, thread, FSID_OPERATION_CHECK, 1, result < 0, start, locked);
+#endif /* FSID_INSTRUMENTED */
+
+    return result;
+}
+
+/* Insert string with computed hash */
+static int fsid_insert_hash(fsid_t _fsid, const char* _string, size_t _length, const uint64_t _hash, bool _external)
+{
+    fsid_thread_t thread = fsid_thread_cache(_fsid);
+    const bool epoch = fsid_epoch_used(_fsid);
+
+#ifdef FSID_INSTRUMENTED
+    const uint64_t start = fsid_sample_start(_fsid, thread);
+#endif /* FSID_INSTRUMENTED */
+
+    if (epoch)
+        fsid_epoch_enter(_fsid, thread);
+
+    if (thread && _fsid->threadCacheSize)
+    {
+        const int value = fsid_thread_check(thread, _string, _length, _hash);
+
+        if (value >= 0)
+        {
+            fsid_epoch_leave(_fsid, thread);
+
+#ifdef FSID_INSTRUMENTED
+            fsid_sample_end(_fsid, thread, FSID_OPERATION_INSERT, 1, 0, start, start);
+#endif /* FSID_INSTRUMENTED */
+            return value;
+        }
+    }
+
+    fsid_t broker = fsid_route_hash(_fsid, _hash);
+    const bool lockfree = (broker->flags & FSID_FLAG_LOCKFREE_WRITERS) != 0;
+    fsid_record_t record = NULL;
+
+    /* Strings already contained are found without lock, so that repeated inserts don't make optimistic readers retry */
+    const bool optimistic = (broker->flags & FSID_FLAG_OPTIMISTIC_READERS) != 0;
+    int value = optimistic ? fsid_check_optimistic(broker, _string, _length, _hash, thread && _fsid->threadCacheSize ? &record : NULL) : FSID_ERR_INVALID_VALUE;
+    const bool found = value > 0;
+
+    if (!lockfree && !found)
+        fsid_rwlock_func(broker);
+
+#ifdef FSID_INSTRUMENTED
+    const uint64_t locked = start ? fsid_clock() : 0;
+#endif /* FSID_INSTRUMENTED */
+
+    /* Lock-free writers insert in the epoch entered above */
+    if (!found)
+        value = lockfree ? fsid_insert_lockfree(broker, _fsid, thread, _string, _length, _hash, _external) : fsid_insert_stringlen_safe(broker, _string, _length, _hash, _external);
+
+    const int result = fsid_public_value(broker, value);
+
+    if (thread && _fsid->threadCacheSize && value > 0)
+        fsid_thread_store(thread, found ? record : fsid_value_record(broker, value), result);
+
+    if (!lockfree && !found)
+        fsid_rwunlock_func(broker);
+
+    if (epoch)
+        fsid_epoch_leave(_fsid, thread);
+
+#ifdef FSID_INSTRUMENTED
+    fsid_sample_end(_fsid, thread, FSID_OPERATION_INSERT, 1, 0, start, locked);
+#endif /* FSID_INSTRUMENTED */
+
+    return result;
+}
+
+uint64_t fsid_hash_stringlen(const fsid_t _fsid, const char* _string, size_t _length)
+{
+    if (!_fsid || !_string)
+        return 0;
+
+    return fsid_hash_func(_fsid, _string, _length);
+}
+
+int fsid_check_string(const fsid_t _fsid, const char* _string)
+{
+    if (_string)
+        return fsid_check_stringlen(_fsid, _string, strlen(_string));
+    return FSID_ERR_INVALID_PARAM;
+}
+
+int fsid_check_stringlen(const fsid_t _fsid, const char* _string, size_t _length)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (!_string)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (_length == 0)
+        return FSID_EMPTY_STRING_VALUE;
+
+    return fsid_check_hash(_fsid, _string, _length, fsid_hash_func(_fsid, _string, _length));
+}
+
+int fsid_check_hashed(const fsid_t _fsid, const char* _string, size_t _length, uint64_t _hash)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (!_string)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (_length == 0)
+        return FSID_EMPTY_STRING_VALUE;
+
+    return fsid_check_hash(_fsid, _string, _length, _hash);
+}
+
+int fsid_insert_string(fsid_t _fsid, const char* _string)
+{
+    if (_string)
+        return fsid_insert_stringlen(_fsid, _string, strlen(_string));
+    return FSID_ERR_INVALID_PARAM;
+}
+
+int fsid_insert_stringlen(fsid_t _fsid, const char* _string, size_t _length)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (!_string)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (_length == 0)
+        return FSID_EMPTY_STRING_VALUE;
+
+    return fsid_insert_hash(_fsid, _string, _length, fsid_hash_func(_fsid, _string, _length), false);
+}
+
+int fsid_insert_hashed(fsid_t _fsid, const char* _string, size_t _length, uint64_t _hash)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (!_string)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (_length == 0)
+        return FSID_EMPTY_STRING_VALUE;
+
+    return fsid_insert_hash(_fsid, _string, _length, _hash, false);
+}
+
+int fsid_insert_external(fsid_t _fsid, const char* _string, size_t _length)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (!_string)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (_length == 0)
+        return FSID_EMPTY_STRING_VALUE;
+
+    return fsid_insert_hash(_fsid, _string, _length, fsid_hash_func(_fsid, _string, _length), true);
+}
+
+/* Prepare delimiter set */
+static void fsid_split_init(fsid_split_t _split, const char* _delimiters)
+{
+    memset(_split->table, 0, sizeof(_split->table));
+    _split->count = 0;
+
+    for (const uint8_t* delimiter = (const uint8_t*)_delimiters; *delimiter; ++delimiter)
+    {
+        if (_split->table[*delimiter])
+            continue;
+
+        _split->table[*delimiter] = 1;
+
+        if (_split->count < FSID_SPLIT_MAX_DELIMITERS)
+            _split->delimiters[_split->count] = *delimiter;
+
+        _split->count++;
+    }
+}
+
+/* Offset of first delimiter, _length if there is none */
+static size_t fsid_split_find(const fsid_split_t _split, const char* _data, size_t _length)
+{
+    size_t offset = 0;
+
+    if (_split->count <= FSID_SPLIT_MAX_DELIMITERS)
+    {
+#if defined(FSID_AVX2)
+        for (; offset + 32 <= _length; offset += 32)
+        {
+            const __m256i chunk = _mm256_loadu_si256((const __m256i*)(_data + offset));
+            __m256i equal = _mm256_setzero_si256();
+
+            for (int index = 0; index < _split->count; ++index)
+                equal = _mm256_or_si256(equal, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8((char)_split->delimiters[index])));
+
+            const uint32_t mask = (uint32_t)_mm256_movemask_epi8(equal);
+
+            if (mask)
+                return offset + fsid_table_first(mask);
+        }
+#endif
+#if defined(FSID_SSE2)
+        for (; offset + 16 <= _length; offset += 16)
+        {
+            const __m128i chunk = _mm_loadu_si128((const __m128i*)(_data + offset));
+            __m128i equal = _mm_setzero_si128();
+
+            for (int index = 0; index < _split->count; ++index)
+                equal = _mm_or_si128(equal, _mm_cmpeq_epi8(chunk, _mm_set1_epi8((char)_split->delimiters[index])));
+
+            const uint32_t mask = (uint32_t)_mm_movemask_epi8(equal);
+
+            if (mask)
+                return offset + fsid_table_first(mask);
+        }
+#elif defined(FSID_NEON)
+        for (; offset + 16 <= _length; offset += 16)
+        {
+            const uint8x16_t chunk = vld1q_u8((const uint8_t*)_data + offset);
+            uint8x16_t equal = vdupq_n_u8(0);
+
+            for (int index = 0; index < _split->count; ++index)
+                equal = vorrq_u8(equal, vceqq_u8(chunk, vdupq_n_u8(_split->delimiters[index])));
+
+            /* Exact position is found by the scalar loop within this chunk */
+            if (vmaxvq_u8(equal))
+                break;
+        }
+#endif
+    }
+
+    while (offset < _length && !_split->table[(uint8_t)_data[offset]])
+        offset++;
+
+    return offset;
+}
+
+/* Insert hashed batch, every shard is locked once */
+static int fsid_insert_batch_hashed(fsid_t _fsid, fsid_batch_t _batch, fsid_batch_t _scratch, size_t _count, int* _values)
+{
+    int result = FSID_SUCCESSFUL;
+    fsid_batch_t sorted = _batch;
+    fsid_batch_t scratch = _scratch;
+    const bool lockfree = (_fsid->flags & FSID_FLAG_LOCKFREE_WRITERS) != 0;
+    fsid_thread_t thread = lockfree ? fsid_thread_cache(_fsid) : NULL;
+
+    /* Split batch into runs of strings owned by the same shard */
+    if (_fsid->shards)
+    {
+        for (size_t index = 0; index < _count; ++index)
+            _batch[index].key = fsid_shard_index(_fsid, _batch[index].hash);
+
+        sorted = fsid_batch_sort(_batch, _scratch, _count);
+        scratch = sorted == _batch ? _scratch : _batch;
+    }
+
+    for (size_t first = 0; first < _count;)
+    {
+        fsid_t broker = fsid_route_hash(_fsid, sorted[first].hash);
+        size_t last = first + 1;
+
+        while (last < _count && fsid_route_hash(_fsid, sorted[last].hash) == broker)
+            last++;
+
+        if (lockfree)
+        {
+            fsid_epoch_enter(_fsid, thread);
+
+            for (size_t index = first; index < last; ++index)
+            {
+                const int value = fsid_insert_lockfree(broker, _fsid, thread, sorted[index].string, sorted[index].length, sorted[index].hash, false);
+
+                if (value < 0)
+                    result = value;
+
+                _values[sorted[index].index] = fsid_public_value(broker, value);
+            }
+
+            fsid_epoch_leave(_fsid, thread);
+            first = last;
+            continue;
+        }
+
+        fsid_rwlock_func(broker);
+        const int batchResult = fsid_insert_batch_safe(broker, sorted + first, scratch + first, last - first, _values);
+        fsid_rwunlock_func(broker);
+
+        if (batchResult != FSID_SUCCESSFUL)
+            result = batchResult;
+
+        first = last;
+    }
+    return result;
+}
+
+int fsid_remove_value(fsid_t _fsid, int _value)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (_fsid->engine == FSID_ENGINE_FROZEN)
+        return FSID_ERR_READ_ONLY;
+
+    if (_value <= FSID_EMPTY_STRING_VALUE)
+        return FSID_ERR_INVALID_VALUE;
+
+    fsid_t broker = fsid_route_value(_fsid, &_value);
+
+    fsid_exclusive_lock(broker);
+    const int result = fsid_tagged_record(broker, &_value) ? fsid_remove_value_safe(broker, _value) : FSID_ERR_INVALID_VALUE;
+    fsid_exclusive_unlock(broker);
+
+    return result;
+}
+
+int fsid_reserve(fsid_t _fsid, size_t _expectedStrings, size_t _expectedBytes)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (_fsid->engine == FSID_ENGINE_FROZEN)
+        return FSID_ERR_READ_ONLY;
+
+    if (!_fsid->shards)
+    {
+        fsid_exclusive_lock(_fsid);
+        const int result = fsid_reserve_safe(_fsid, _expectedStrings, _expectedBytes);
+        fsid_exclusive_unlock(_fsid);
+
+        return result;
+    }
+
+    /* Strings are spread evenly over the shards by hash */
+    const uint32_t count = 1u << _fsid->shardBits;
+    const size_t strings = _expectedStrings / count + (_expectedStrings % count != 0);
+    const size_t bytes = _expectedBytes / count + (_expectedBytes % count != 0);
+
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        fsid_t shard = _fsid->shards[index];
+
+        fsid_exclusive_lock(shard);
+        const int result = fsid_reserve_safe(shard, strings, bytes);
+        fsid_exclusive_unlock(shard);
+
+        if (result != FSID_SUCCESSFUL)
+            return result;
+    }
+
+    return FSID_SUCCESSFUL;
+}
+
+int fsid_compact(fsid_t _fsid)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    /* Frozen image is laid out contiguously when it is written */
+    if (_fsid->engine == FSID_ENGINE_FROZEN)
+        return FSID_SUCCESSFUL;
+
+    if (!_fsid->shards)
+    {
+        fsid_exclusive_lock(_fsid);
+        const int result = fsid_compact_safe(_fsid);
+        fsid_exclusive_unlock(_fsid);
+
+        return result;
+    }
+
+    const uint32_t count = 1u << _fsid->shardBits;
+
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        fsid_t shard = _fsid->shards[index];
+
+        fsid_exclusive_lock(shard);
+        const int result = fsid_compact_safe(shard);
+        fsid_exclusive_unlock(shard);
+
+        if (result != FSID_SUCCESSFUL)
+            return result;
+    }
+
+    return FSID_SUCCESSFUL;
+}
+
+int fsid_insert_batch(fsid_t _fsid, const char* const* _strings, const size_t* _lengths, size_t _count, int* _values)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (!_strings || !_values)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (_count == 0)
+        return FSID_SUCCESSFUL;
+
+    const size_t size = sizeof(struct fsid_batch_struct) * _count * 2;
+    fsid_batch_t batch = (fsid_batch_t)fsid_alloc_func(_fsid, size);
+
+    if (!batch)
+    {
+        for (size_t index = 0; index < _count; ++index)
+            _values[index] = FSID_ERR_OUT_OF_MEMORY;
+
+        return FSID_ERR_OUT_OF_MEMORY;
+    }
+
+    int result = FSID_SUCCESSFUL;
+    const size_t count = fsid_batch_hash(_fsid, batch, _strings, _lengths, _count, _values, &result);
+    const int batchResult = fsid_insert_batch_hashed(_fsid, batch, batch + _count, count, _values);
+
+    fsid_free_func(_fsid, batch, size);
+
+#ifdef FSID_INSTRUMENTED
+    fsidProbeSteps = 0;
+    fsid_sample_end(_fsid, fsid_thread_cache(_fsid), FSID_OPERATION_INSERT, _count, 0, 0, 0);
+#endif /* FSID_INSTRUMENTED */
+
+    return batchResult != FSID_SUCCESSFUL ? batchResult : result;
+}
+
+int fsid_check_batch(const fsid_t _fsid, const char* const* _strings, const size_t* _lengths, size_t _count, int* _values)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (!_strings || !_values)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (_count == 0)
+        return FSID_SUCCESSFUL;
+
+    const uint32_t shardsCount = _fsid->shards ? 1u << _fsid->shardBits : 0;
+    const bool epoch = fsid_readers_unlocked(_fsid);
+    fsid_thread_t thread = epoch ? fsid_thread_cache(_fsid) : NULL;
+    int result = FSID_SUCCESSFUL;
+    bool valid = false;
+
+    if (epoch)
+        fsid_epoch_enter(_fsid, thread);
+
+    /* Batch is checked optimistically once, if a writer changed any shard meanwhile it is checked again under lock */
+    if (_fsid->flags & FSID_FLAG_OPTIMISTIC_READERS)
+    {
+        uint32_t sequences[1u << FSID_SHARD_MAX_BITS];
+
+        for (uint32_t index = 0; index < (1u << _fsid->shardBits); ++index)
+            sequences[index] = fsid_read_begin(fsid_shard(_fsid, index));
+
+        result = fsid_check_batch_safe(_fsid, _strings, _lengths, _count, _values);
+        valid = true;
+
+        for (uint32_t index = 0; valid && index < (1u << _fsid->shardBits); ++index)
+            valid = fsid_read_valid(fsid_shard(_fsid, index), sequences[index]);
+    }
+
+    if (!valid)
+    {
+        /* Shards are always locked in the same order */
+        for (uint32_t index = 0; index < shardsCount; ++index)
+            fsid_rolock_func(_fsid->shards[index]);
+
+        if (!shardsCount)
+            fsid_rolock_func(_fsid);
+
+        result = fsid_check_batch_safe(_fsid, _strings, _lengths, _count, _values);
+
+        if (!shardsCount)
+            fsid_rounlock_func(_fsid);
+
+        for (uint32_t index = shardsCount; index > 0; --index)
+            fsid_rounlock_func(_fsid->shards[index - 1]);
+    }
+
+    if (epoch)
+        fsid_epoch_leave(_fsid, thread);
+
+#ifdef FSID_INSTRUMENTED
+    uint64_t misses = 0;
+
+    for (size_t index = 0; index < _count; ++index)
+        misses += _values[index] == FSID_ERR_INVALID_VALUE;
+
+    fsidProbeSteps = 0;
+    fsid_sample_end(_fsid, fsid_thread_cache(_fsid), FSID_OPERATION_CHECK, _count, misses, 0, 0);
+#endif /* FSID_INSTRUMENTED */
+
+    return result;
+}
+
+int fsid_check_value(fsid_t _fsid, int _value, const char** _pointer, size_t* _length)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    if (_value == FSID_EMPTY_STRING_VALUE)
+    {
+        if (_pointer)
+            *_pointer = emptyString;
+
+        if (_length)
+            *_length = 0;
+
+        return FSID_SUCCESSFUL;
+    }
+
+    if (_value < 0)
+        return fsid_check_value_safe(_fsid, _value, _pointer, _length);
+
+    fsid_t broker = fsid_route_value(_fsid, &_value);
+    const bool epoch = fsid_readers_unlocked(_fsid);
+    fsid_thread_t thread = epoch ? fsid_thread_cache(_fsid) : NULL;
+    int result;
+
+    if (epoch)
+        fsid_epoch_enter(_fsid, thread);
+
+    if (broker->flags & FSID_FLAG_OPTIMISTIC_READERS)
+    {
+        const char* pointer = NULL;
+        size_t length = 0;
+        uint32_t sequence;
+
+        do
+        {
+            sequence = fsid_read_begin(broker);
+            result = fsid_check_value_safe(broker, _value, &pointer, &length);
+        }
+        while (!fsid_read_valid(broker, sequence));
+
+        if (_pointer)
+            *_pointer = pointer;
+
+        if (_length)
+            *_length = length;
+    }
+    else
+    {
+        fsid_rolock_func(broker);
+        result = fsid_check_value_safe(broker, _value, _pointer, _length);
+        fsid_rounlock_func(broker);
+    }
+
+    if (epoch)
+        fsid_epoch_leave(_fsid, thread);
+
+    return result;
+}
+
+/* Number of local values of broker, values below it may hold strings */
+static inline int fsid_value_limit(const fsid_t _broker)
+{
+    if (_broker->engine == FSID_ENGINE_FROZEN)
+        return (int)_broker->frozen->valuesCount;
+
+    return FSID_LOAD_ACQUIRE(&_broker->nextValue);
+}
+
+/* Public value of local value of broker holding a string, slots of frozen image keep the public value in their entry */
+static inline int fsid_value_public(const fsid_t _broker, int _value)
+{
+    if (_broker->engine == FSID_ENGINE_FROZEN)
+        return (int)fsid_read32(fsid_frozen_slot_entry(_broker->frozen, (uint64_t)_value) + 20);
+
+    return fsid_public_value(_broker, _value);
+}
+
+/* String of local value of broker, NULL if the value holds no string */
+static const char* fsid_value_string(const fsid_t _broker, int _value, size_t* _length)
+{
+    if (_broker->engine == FSID_ENGINE_FROZEN)
+    {
+        const uint8_t* entry = fsid_frozen_slot_entry(_broker->frozen, (uint64_t)_value);
+
+        return entry ? fsid_frozen_string(_broker->frozen, entry, _length) : NULL;
+    }
+
+    const fsid_record_t record = fsid_value_record(_broker, _value);
+
+    if (!record)
+        return NULL;
+
+    *_length = fsid_record_length(record);
+    return fsid_record_data(record);
+}
+
+int fsid_foreach(fsid_t _fsid, fsid_visit _visitFunc, void* _userData)
+{
+    if (!_fsid || !_visitFunc)
+        return FSID_ERR_INVALID_PARAM;
+
+    const bool frozen = _fsid->engine == FSID_ENGINE_FROZEN;
+    const uint32_t shardsCount = frozen ? 1 : 1u << _fsid->shardBits;
+    int result = FSID_SUCCESSFUL;
+
+    if (!frozen)
+        fsid_snapshot_lock(_fsid);
+
+    for (uint32_t shard = 0; shard < shardsCount && result == FSID_SUCCESSFUL; ++shard)
+    {
+        const fsid_t broker = fsid_shard(_fsid, shard);
+        const int limit = fsid_value_limit(broker);
+
+        for (int value = FSID_EMPTY_STRING_VALUE + 1; value < limit && result == FSID_SUCCESSFUL; ++value)
+        {
+            size_t length = 0;
+            const char* string = fsid_value_string(broker, value, &length);
+
+            if (string)
+                result = _visitFunc(_userData, fsid_value_public(broker, value), string, length);
+        }
+    }
+
+    if (!frozen)
+        fsid_snapshot_unlock(_fsid);
+
+    return result;
+}
+
+int fsid_iterate_next(fsid_t _fsid, fsid_cursor_t* _cursor, int* _values, const char** _pointers, size_t* _lengths, size_t _maxCount)
+{
+    if (!_fsid || !_cursor || !_values)
+        return FSID_ERR_INVALID_PARAM;
+
+    const bool frozen = _fsid->engine == FSID_ENGINE_FROZEN;
+    const uint32_t shardsCount = frozen ? 1 : 1u << _fsid->shardBits;
+    /* Lock-free inserts publish records they may lose and drop, they are stopped like by fsid_foreach */
+    const bool exclusive = !frozen && (_fsid->flags & FSID_FLAG_LOCKFREE_WRITERS);
+    const bool epoch = !exclusive && fsid_readers_unlocked(_fsid);
+    fsid_thread_t thread = epoch ? fsid_thread_cache(_fsid) : NULL;
+    size_t count = 0;
+
+    if (_maxCount > INT_MAX)
+        _maxCount = INT_MAX;
+
+    if (epoch)
+        fsid_epoch_enter(_fsid, thread);
+
+    /* Only one shard is locked at a time */
+    while (count < _maxCount && _cursor->shard < shardsCount)
+    {
+        const fsid_t broker = fsid_shard(_fsid, _cursor->shard);
+        int value = _cursor->value > FSID_EMPTY_STRING_VALUE ? _cursor->value : FSID_EMPTY_STRING_VALUE + 1;
+
+        if (exclusive)
+            fsid_exclusive_lock(broker);
+        else if (!frozen)
+            fsid_rolock_func(broker);
+
+        const int limit = fsid_value_limit(broker);
+
+        for (; value < limit && count < _maxCount; ++value)
+        {
+            size_t length = 0;
+            const char* string = fsid_value_string(broker, value, &length);
+
+            if (!string)
+                continue;
+
+            _values[count] = fsid_value_public(broker, value);
+
+            if (_pointers)
+                _pointers[count] = string;
+
+            if (_lengths)
+                _lengths[count] = length;
+
+            count++;
+        }
+
+        if (exclusive)
+            fsid_exclusive_unlock(broker);
+        else if (!frozen)
+            fsid_rounlock_func(broker);
+
+        if (value < limit)
+        {
+            _cursor->value = value;
+        }
+        else
+        {
+            _cursor->shard++;
+            _cursor->value = FSID_EMPTY_STRING_VALUE + 1;
+        }
+    }
+
+    if (epoch)
+        fsid_epoch_leave(_fsid, thread);
+
+    return (int)count;
+}
+
+int fsid_save(fsid_t _fsid, fsid_write _writeFunc, void* _userData)
+{
+    if (!_fsid || !_writeFunc || _fsid->engine == FSID_ENGINE_FROZEN)
+        return FSID_ERR_INVALID_PARAM;
+
+    struct fsid_writer_struct writer;
+
+    writer.writeFunc = _writeFunc;
+    writer.userData = _userData;
+    writer.used = 0;
+    writer.failed = false;
+
+    fsid_snapshot_lock(_fsid);
+    fsid_save_safe(_fsid, &writer);
+    fsid_snapshot_unlock(_fsid);
+
+    return writer.failed ? FSID_ERR_IO : FSID_SUCCESSFUL;
+}
+
+int fsid_save_file(fsid_t _fsid, const char* _path)
+{
+    if (!_fsid || !_path)
+        return FSID_ERR_INVALID_PARAM;
+
+    FILE* file = fopen(_path, "wb");
+
+    if (!file)
+        return FSID_ERR_IO;
+
+    int result = fsid_save(_fsid, &fsid_write_file, file);
+
+    if (fclose(file) != 0 && result == FSID_SUCCESSFUL)
+        result = FSID_ERR_IO;
+
+    return result;
+}
+
+int fsid_load(fsid_t* _fsid, const fsid_init_t* _params, fsid_read _readFunc, void* _userData)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    *_fsid = NULL;
+
+    if (!_readFunc)
+        return FSID_ERR_INVALID_PARAM;
+
+    int result = fsid_initialize(_fsid, _params);
+
+    if (result != FSID_SUCCESSFUL)
+        return result;
+
+    result = fsid_load_safe(*_fsid, _readFunc, _userData);
+
+    if (result != FSID_SUCCESSFUL)
+    {
+        fsid_release(*_fsid);
+        *_fsid = NULL;
+    }
+
+    return result;
+}
+
+int fsid_load_file(fsid_t* _fsid, const fsid_init_t* _params, const char* _path)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    *_fsid = NULL;
+
+    if (!_path)
+        return FSID_ERR_INVALID_PARAM;
+
+    FILE* file = fopen(_path, "rb");
+
+    if (!file)
+        return FSID_ERR_IO;
+
+    int result = fsid_load(_fsid, _params, &fsid_read_file, file);
+
+    fclose(file);
+    return result;
+}
+
+int fsid_freeze(fsid_t _fsid, fsid_write _writeFunc, void* _userData)
+{
+    if (!_fsid || !_writeFunc || _fsid->engine == FSID_ENGINE_FROZEN)
+        return FSID_ERR_INVALID_PARAM;
+
+    struct fsid_writer_struct writer;
+
+    writer.writeFunc = _writeFunc;
+    writer.userData = _userData;
+    writer.used = 0;
+    writer.failed = false;
+
+    fsid_snapshot_lock(_fsid);
+    int result = fsid_freeze_safe(_fsid, &writer);
+    fsid_snapshot_unlock(_fsid);
+
+    if (result == FSID_SUCCESSFUL && writer.failed)
+        result = FSID_ERR_IO;
+
+    return result;
+}
+
+int fsid_freeze_file(fsid_t _fsid, const char* _path)
+{
+    if (!_fsid || !_path)
+        return FSID_ERR_INVALID_PARAM;
+
+    FILE* file = fopen(_path, "wb");
+
+    if (!file)
+        return FSID_ERR_IO;
+
+    int result = fsid_freeze(_fsid, &fsid_write_file, file);
+
+    if (fclose(file) != 0 && result == FSID_SUCCESSFUL)
+        result = FSID_ERR_IO;
+
+    return result;
+}
+
+int fsid_open_image(fsid_t* _fsid, const fsid_init_t* _params, const void* _data, size_t _size)
+{
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
+
+    *_fsid = NULL;
+
+    if (!_data)
+        return FSID_ERR_INVALID_PARAM;
+
+    int result = fsid_frozen_create(_fsid, _params, 0);
+
+    if (result != FSID_SUCCESSFUL)
+        return result;
 
-        while (record)
-        {
-            if (record->length == _length && memcmp(record->data, _string, _length) == 0)
-                return record->value;
+    result = fsid_frozen_parse(*_fsid, (const uint8_t*)_data, _size);
 
-            record = record->next;
-        }
+    if (result != FSID_SUCCESSFUL)
+    {
+        fsid_release(*_fsid);
+        *_fsid = NULL;
     }
-    return FSID_ERR_INVALID_VALUE;
+
+    return result;
 }
 
-int fsid_insert_stringlen_safe(fsid_t _fsid, const char* _string, size_t _length, const uint32_t _hash)
+int fsid_open_mapped(fsid_t* _fsid, const fsid_init_t* _params, const char* _path)
 {
-    fsid_node_t stack[FSID_NODE_MAX_LEVEL];
-    fsid_node_t node = _fsid->root;
-    int stackCount = 0;
-    bool newNode = false;
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
 
-    for (;;)
-    {
-        if (!node)
-        {
-            node = fsid_node_create(_fsid, _hash);
+    *_fsid = NULL;
 
-            if (!node)
-                return FSID_ERR_OUT_OF_MEMORY;
+    if (!_path)
+        return FSID_ERR_INVALID_PARAM;
 
-            stack[stackCount++] = node;
-            newNode = true;
-            break;
-        }
-        else if (_hash == fsid_node_hash(node))
-        {
-            break;
-        }
-        else if (_hash < fsid_node_hash(node))
-        {
-            stack[stackCount++] = node;
-            node = node->left;
-        }
-        else
-        {
-            stack[stackCount++] = node;
-            node = node->right;
-        }
-    }
+    int result = fsid_frozen_create(_fsid, _params, 0);
 
-    if (newNode)
-    {
-        while (stackCount > 0)
-        {
-            fsid_node_t node = stack[--stackCount];
-            node = fsid_node_balance(node);
+    if (result != FSID_SUCCESSFUL)
+        return result;
 
-            if (stackCount > 0)
-            {
-                fsid_node_t parent = stack[stackCount - 1];
+    result = fsid_frozen_map(*_fsid, _path);
 
-                if (fsid_node_hash(node) < fsid_node_hash(parent))
-                    parent->left = node;
-                else
-                    parent->right = node;
-            }
-            else
-            {
-                _fsid->root = node;
-            }
-        }
+    if (result == FSID_SUCCESSFUL)
+        result = fsid_frozen_parse(*_fsid, (const uint8_t*)(*_fsid)->frozen->mapping, (*_fsid)->frozen->mappingSize);
+
+    if (result != FSID_SUCCESSFUL)
+    {
+        fsid_release(*_fsid);
+        *_fsid = NULL;
     }
 
-    fsid_record_t record = node->record;
+    return result;
+}
 
-    while (record)
-    {
-        if (record->length == _length && memcmp(record->data, _string, _length) == 0)
-            return record->value;
+int fsid_open_replica(fsid_t* _replica, const fsid_init_t* _params, fsid_t _fsid)
+{
+    if (!_replica)
+        return FSID_ERR_INVALID_PARAM;
 
-        record = record->next;
-    }
+    *_replica = NULL;
 
-    record = fsid_record_create(_fsid, _fsid->nextValue, _string, _length);
+    if (!_fsid || _fsid->engine == FSID_ENGINE_FROZEN)
+        return FSID_ERR_INVALID_PARAM;
 
-    if (!record)
-        return FSID_ERR_OUT_OF_MEMORY;
+    int result = fsid_frozen_create(_replica, _params, _params ? _params->flags & FSID_FLAG_HUGE_PAGES : 0);
 
-    _fsid->nextValue++;
-    record->next = node->record;
-    node->record = record;
-    return record->value;
+    if (result != FSID_SUCCESSFUL)
+        return result;
+
+    result = fsid_replica_fill(*_replica, _fsid);
+
+    if (result != FSID_SUCCESSFUL)
+    {
+        fsid_release(*_replica);
+        *_replica = NULL;
+    }
+
+    return result;
 }
 
-int fsid_check_value_safe(fsid_t _fsid, int _value, const char** _pointer, size_t* _length)
+int fsid_refresh_replica(fsid_t* _refreshed, fsid_t _replica, fsid_t _fsid)
 {
-    fsid_node_pool_t pool = _fsid->pool;
+    if (!_refreshed)
+        return FSID_ERR_INVALID_PARAM;
 
-    while (pool)
-    {
-        for (size_t index = 0; index < pool->count; ++index)
-        {
-            fsid_node_t node = &pool->nodes[index];
-            fsid_record_t record = node->record;
+    *_refreshed = NULL;
 
-            while (record)
-            {
-                if (record->value == _value)
-                {
-                    if (_pointer)
-                        *_pointer = record->data;
+    if (!_replica || !_fsid || _replica->engine != FSID_ENGINE_FROZEN || _replica->frozen->sourceSerial != _fsid->serial)
+        return FSID_ERR_INVALID_PARAM;
 
-                    if (_length)
-                        *_length = record->length;
+    if (fsid_contents_version(_fsid) == _replica->frozen->sourceVersion)
+        return FSID_SUCCESSFUL;
 
-                    return FSID_SUCCESSFUL;
-                }
+    /* New replica takes memory from the same allocator */
+    fsid_init_t params;
 
-                record = record->next;
-            }
-        }
-        pool = pool->next;
-    }
+    memset(&params, 0, sizeof(params));
+    params.userData = _replica->userData;
+    params.allocFunc = _replica->allocFunc;
+    params.freeFunc = _replica->freeFunc;
 
-    if (_pointer)
-        *_pointer = NULL;
+    int result = fsid_frozen_create(_refreshed, &params, _replica->flags & FSID_FLAG_HUGE_PAGES);
 
-    if (_length)
-        *_length = 0;
+    if (result != FSID_SUCCESSFUL)
+        return result;
 
-    return FSID_ERR_INVALID_VALUE;
-}
+    result = fsid_replica_fill(*_refreshed, _fsid);
 
+    if (result != FSID_SUCCESSFUL)
+    {
+        fsid_release(*_refreshed);
+        *_refreshed = NULL;
+    }
 
-/* Public methods */
+    return result;
+}
 
-#ifdef FSID_STATISTICS
-int fsid_get_statistics(fsid_statistics_t* _stat, const fsid_t _fsid)
+int fsid_intern_split(fsid_t _fsid, const char* _buffer, size_t _length, const char* _delimiters, int* _values, size_t _maxValues)
 {
-    if (!_stat)
+    if (!_fsid)
         return FSID_ERR_INVALID_PARAM;
 
-    if (!_fsid)
+    if (!_buffer || !_delimiters || !*_delimiters || (!_values && _maxValues))
         return FSID_ERR_INVALID_PARAM;
 
-    _stat->memorySize = _fsid->memorySize;
-    _stat->hashesCount = _fsid->nodesCount;
-    _stat->valuesCount = _fsid->recordsCount;
-    return FSID_SUCCESSFUL;
-}
-#endif /* FSID_STATISTICS */
+    if (_length == 0)
+        return 0;
 
-/**
-*/
-int fsid_initialize(fsid_t* _fsid, const fsid_init_t* _params)
-{
-    void* userData = NULL;
-    fsid_alloc fAlloc = &fsid_alloc_default;
-    fsid_free fFree = &fsid_free_default;
-    fsid_hash fHash = &fsid_hash_default;
-    fsid_rolock fROLock = &fsid_lock_default;
-    fsid_rounlock fROUnlock = &fsid_unlock_default;
-    fsid_rwlock fRWLock = &fsid_lock_default;
-    fsid_rwunlock fRWUnlock = &fsid_unlock_default;
-    fsid_t fsid_internal = NULL;
+    struct fsid_split_struct split;
+    struct fsid_batch_struct stackBatch[FSID_SPLIT_STACK_FIELDS * 2];
+    const size_t capacity = _maxValues < _length + 1 ? _maxValues : _length + 1;
+    fsid_batch_t batch = stackBatch;
+    size_t size = 0;
 
-    if (!_fsid)
-        return FSID_ERR_INVALID_PARAM;
+    if (capacity > FSID_SPLIT_STACK_FIELDS)
+    {
+        size = sizeof(struct fsid_batch_struct) * capacity * 2;
+        batch = (fsid_batch_t)fsid_alloc_func(_fsid, size);
 
-    if (_params)
+        if (!batch)
+            return FSID_ERR_OUT_OF_MEMORY;
+    }
+
+    fsid_split_init(&split, _delimiters);
+
+    size_t fields = 0;
+    size_t count = 0;
+    size_t offset = 0;
+
+    /* Fields are hashed in place while scanning, fields past _maxValues are only counted */
+    for (;;)
     {
-        userData = _params->userData;
+        const char* string = _buffer + offset;
+        const size_t length = fsid_split_find(&split, string, _length - offset);
 
-        if (_params->allocFunc && _params->freeFunc)
-        {
-            fAlloc = _params->allocFunc;
-            fFree = _params->freeFunc;
-        }
-        else if (_params->allocFunc || _params->freeFunc)
+        if (fields < _maxValues)
         {
-            return FSID_ERR_INVALID_PARAM;
+            if (length == 0)
+            {
+                _values[fields] = FSID_EMPTY_STRING_VALUE;
+            }
+            else
+            {
+                batch[count].hash = fsid_hash_func(_fsid, string, length);
+                batch[count].key = (uint32_t)(batch[count].hash >> 32);
+                batch[count].index = fields;
+                batch[count].string = string;
+                batch[count].length = length;
+                count++;
+            }
         }
 
-        if (_params->rwlockFunc && _params->rwunlockFunc)
-        {
-            fRWLock = _params->rwlockFunc;
-            fRWUnlock = _params->rwunlockFunc;
-        }
-        else if (_params->rwlockFunc || _params->rwunlockFunc)
-        {
-            return FSID_ERR_INVALID_PARAM;
-        }
+        fields++;
+        offset += length;
 
-        if (_params->rolockFunc && _params->rounlockFunc)
-        {
-            fROLock = _params->rolockFunc;
-            fROUnlock = _params->rounlockFunc;
-        }
-        else if (!_params->rolockFunc && !_params->rounlockFunc)
-        {
-            fROLock = fRWLock;
-            fROUnlock = fRWUnlock;
-        }
-        else
-        {
-            return FSID_ERR_INVALID_PARAM;
-        }
+        if (offset == _length)
+            break;
 
-        if (_params->hashFunc)
-        {
-            fHash = _params->hashFunc;
-        }
+        offset++;
     }
 
-    fsid_internal = (fsid_t)fAlloc(userData, sizeof(struct fsid_struct));
-    
-    if (!fsid_internal)
-        return FSID_ERR_OUT_OF_MEMORY;
+    const int result = fsid_insert_batch_hashed(_fsid, batch, batch + capacity, count, _values);
 
-    memset(fsid_internal, 0, sizeof(struct fsid_struct));
+    if (size)
+        fsid_free_func(_fsid, batch, size);
 
-    fsid_internal->userData = userData;
-    fsid_internal->allocFunc = fAlloc;
-    fsid_internal->freeFunc = fFree;
-    fsid_internal->hashFunc = fHash;
-    fsid_internal->rolockFunc = fROLock;
-    fsid_internal->rounlockFunc = fROUnlock;
-    fsid_internal->rwlockFunc = fRWLock;
-    fsid_internal->rwunlockFunc = fRWUnlock;
+#ifdef FSID_INSTRUMENTED
+    fsidProbeSteps = 0;
+    fsid_sample_end(_fsid, fsid_thread_cache(_fsid), FSID_OPERATION_INSERT, fields < _maxValues ? fields : _maxValues, 0, 0, 0);
+#endif /* FSID_INSTRUMENTED */
 
-    fsid_internal->nextValue = FSID_EMPTY_STRING_VALUE + 1;
-    fsid_internal->memorySize = sizeof(struct fsid_struct);
+    if (result != FSID_SUCCESSFUL)
+        return result;
 
-    *_fsid = fsid_internal;
-    return FSID_SUCCESSFUL;
+    return fields > INT_MAX ? INT_MAX : (int)fields;
 }
 
-/**
-*/
-int fsid_release(fsid_t _fsid)
+/* Insert collected strings of merge into destination broker, their values are stored to remap array at the source values */
+static int fsid_merge_batch(fsid_t _dst, fsid_batch_t _batch, size_t _count, const int* _sources, int* _values, int* _remap)
 {
-    if (!_fsid)
+    const int result = fsid_insert_batch_hashed(_dst, _batch, _batch + FSID_MERGE_BATCH_SIZE, _count, _values);
+
+    if (_remap)
+    {
+        for (size_t index = 0; index < _count; ++index)
+            _remap[_sources[index]] = _values[index];
+    }
+    return result;
+}
+
+int fsid_merge(fsid_t _dst, fsid_t _src, int* _remap, size_t _remapSize)
+{
+    if (!_dst || !_src || _dst == _src)
         return FSID_ERR_INVALID_PARAM;
 
-    fsid_node_pool_t pool = _fsid->pool;
+    if (_dst->engine == FSID_ENGINE_FROZEN)
+        return FSID_ERR_READ_ONLY;
+
+    const bool frozen = _src->engine == FSID_ENGINE_FROZEN;
+    const uint32_t shardsCount = frozen ? 1 : 1u << _src->shardBits;
+
+    /* Hashes of records are reused if both brokers hash alike */
+    const bool sameHash = !frozen && _dst->hash64Func == _src->hash64Func && _dst->hashFunc == _src->hashFunc && _dst->userData == _src->userData && _dst->hashSeed == _src->hashSeed;
+
+    size_t strings = 0;
+    size_t bytes = 0;
+    int maxValue = FSID_EMPTY_STRING_VALUE;
 
-    while (pool)
+    if (!frozen)
+        fsid_snapshot_lock(_src);
+
+    for (uint32_t shard = 0; shard < shardsCount; ++shard)
     {
-        fsid_node_pool_t next = pool->next;
+        const fsid_t broker = fsid_shard(_src, shard);
+        const int limit = fsid_value_limit(broker);
 
-        for (size_t i = 0; i < pool->count; ++i)
+        for (int value = FSID_EMPTY_STRING_VALUE + 1; value < limit; ++value)
         {
-            fsid_node_t node = &pool->nodes[i];
-            fsid_record_t record = node->record;
+            size_t length = 0;
 
-            while (record)
-            {
-                fsid_record_t rnext = record->next;
-                fsid_record_destroy(_fsid, record);
-                record = rnext;
-            }
-#ifdef FSID_STATISTICS
-            _fsid->nodesCount--;
-#endif /* FSID_STATISTICS */
+            if (!fsid_value_string(broker, value, &length))
+                continue;
+
+            const int source = fsid_value_public(broker, value);
+
+            if (source > maxValue)
+                maxValue = source;
+
+            strings++;
+            bytes += length;
         }
+    }
+
+    /* Remap array is checked before anything is inserted */
+    if (_remap && (size_t)maxValue >= _remapSize)
+    {
+        if (!frozen)
+            fsid_snapshot_unlock(_src);
 
-        fsid_free_func(_fsid, pool, sizeof(struct fsid_node_pool_struct));
-        pool = next;
+        return FSID_ERR_INVALID_PARAM;
     }
 
-    void* userData = _fsid->userData;
-    fsid_free fFree = _fsid->freeFunc;
+    const size_t size = (sizeof(struct fsid_batch_struct) * 2 + sizeof(int) * 2) * FSID_MERGE_BATCH_SIZE;
+    fsid_batch_t batch = (fsid_batch_t)fsid_alloc_func(_dst, size);
+    int result = batch ? fsid_reserve(_dst, strings, bytes) : FSID_ERR_OUT_OF_MEMORY;
 
-    fFree(userData, _fsid);
+    if (result != FSID_SUCCESSFUL)
+    {
+        if (batch)
+            fsid_free_func(_dst, batch, size);
 
-    return FSID_SUCCESSFUL;
-}
+        if (!frozen)
+            fsid_snapshot_unlock(_src);
 
-int fsid_check_string(const fsid_t _fsid, const char* _string)
-{
-    if (_string)
-        return fsid_check_stringlen(_fsid, _string, strlen(_string));
-    return FSID_ERR_INVALID_PARAM;
-}
+        return result;
+    }
 
-int fsid_check_stringlen(const fsid_t _fsid, const char* _string, size_t _length)
-{
-    if (!_fsid)
-        return FSID_ERR_INVALID_PARAM;
+    if (_remap)
+    {
+        _remap[FSID_EMPTY_STRING_VALUE] = FSID_EMPTY_STRING_VALUE;
 
-    if (!_string)
-        return FSID_ERR_INVALID_PARAM;
+        for (size_t index = FSID_EMPTY_STRING_VALUE + 1; index < _remapSize; ++index)
+            _remap[index] = FSID_ERR_INVALID_VALUE;
+    }
 
-    if (_length == 0)
-        return FSID_EMPTY_STRING_VALUE;
+    int* sources = (int*)(batch + FSID_MERGE_BATCH_SIZE * 2);
+    int* values = sources + FSID_MERGE_BATCH_SIZE;
+    size_t count = 0;
 
-    const uint32_t hash = fsid_hash_func(_fsid, _string, _length);
+    /* Strings are inserted in order of source values shard by shard, so merging into an empty broker assigns dense values */
+    for (uint32_t shard = 0; shard < shardsCount; ++shard)
+    {
+        const fsid_t broker = fsid_shard(_src, shard);
+        const int limit = fsid_value_limit(broker);
 
-    fsid_rolock_func(_fsid);
-    int result = fsid_check_stringlen_safe(_fsid, _string, _length, hash);
-    fsid_rounlock_func(_fsid);
+        for (int value = FSID_EMPTY_STRING_VALUE + 1; value < limit; ++value)
+        {
+            size_t length = 0;
+            const char* string = fsid_value_string(broker, value, &length);
 
-    return result;
-}
+            if (!string)
+                continue;
 
-int fsid_insert_string(fsid_t _fsid, const char* _string)
-{
-    if (_string)
-        return fsid_insert_stringlen(_fsid, _string, strlen(_string));
-    return FSID_ERR_INVALID_PARAM;
-}
+            batch[count].hash = sameHash ? fsid_record_hash(broker->values->records[value]) : fsid_hash_func(_dst, string, length);
+            batch[count].key = (uint32_t)(batch[count].hash >> 32);
+            batch[count].index = count;
+            batch[count].string = string;
+            batch[count].length = length;
+            sources[count++] = fsid_value_public(broker, value);
 
-int fsid_insert_stringlen(fsid_t _fsid, const char* _string, size_t _length)
-{
-    if (!_fsid)
-        return FSID_ERR_INVALID_PARAM;
+            if (count == FSID_MERGE_BATCH_SIZE)
+            {
+                const int batchResult = fsid_merge_batch(_dst, batch, count, sources, values, _remap);
 
-    if (!_string)
-        return FSID_ERR_INVALID_PARAM;
+                if (batchResult != FSID_SUCCESSFUL)
+                    result = batchResult;
 
-    if (_length == 0)
-        return FSID_EMPTY_STRING_VALUE;
+                count = 0;
+            }
+        }
+    }
 
-    const uint32_t hash = fsid_hash_func(_fsid, _string, _length);
+    if (count)
+    {
+        const int batchResult = fsid_merge_batch(_dst, batch, count, sources, values, _remap);
 
-    fsid_rwlock_func(_fsid);
-    int result = fsid_insert_stringlen_safe(_fsid, _string, _length, hash);
-    fsid_rwunlock_func(_fsid);
+        if (batchResult != FSID_SUCCESSFUL)
+            result = batchResult;
+    }
+
+    if (!frozen)
+        fsid_snapshot_unlock(_src);
+
+    fsid_free_func(_dst, batch, size);
+
+#ifdef FSID_INSTRUMENTED
+    fsidProbeSteps = 0;
+    fsid_sample_end(_dst, fsid_thread_cache(_dst), FSID_OPERATION_INSERT, strings, 0, 0, 0);
+#endif /* FSID_INSTRUMENTED */
 
     return result;
 }
 
-int fsid_check_value(fsid_t _fsid, int _value, const char** _pointer, size_t* _length)
+#ifdef FSID_INSTRUMENTATION
+int fsid_get_counters(fsid_counters_t* _counters, const fsid_t _fsid)
 {
-    if (!_fsid)
+    if (!_counters)
         return FSID_ERR_INVALID_PARAM;
 
-    if (_value == FSID_EMPTY_STRING_VALUE)
-    {
-        if (_pointer)
-            *_pointer = emptyString;
+    if (!_fsid)
+        return FSID_ERR_INVALID_PARAM;
 
-        if (_length)
-            *_length = 0;
+    memset(_counters, 0, sizeof(*_counters));
 
-        return FSID_SUCCESSFUL;
+#ifdef FSID_INSTRUMENTED
+    for (fsid_thread_t thread = FSID_LOAD_ACQUIRE(&_fsid->threads); thread; thread = thread->next)
+    {
+        _counters->checks += FSID_LOAD_RELAXED(&thread->checks);
+        _counters->checkMisses += FSID_LOAD_RELAXED(&thread->checkMisses);
+        _counters->inserts += FSID_LOAD_RELAXED(&thread->inserts);
+        _counters->probeSteps += FSID_LOAD_RELAXED(&thread->probeSteps);
+        _counters->samples += FSID_LOAD_RELAXED(&thread->samples);
+        _counters->sampleNanoseconds += FSID_LOAD_RELAXED(&thread->sampleNanoseconds);
+        _counters->lockNanoseconds += FSID_LOAD_RELAXED(&thread->lockNanoseconds);
     }
+#endif /* FSID_INSTRUMENTED */
 
-    fsid_rolock_func(_fsid);
-    int result = fsid_check_value_safe(_fsid, _value, _pointer, _length);
-    fsid_rounlock_func(_fsid);
-
-    return result;
+    return FSID_SUCCESSFUL;
 }
+#endif /* FSID_INSTRUMENTATION */
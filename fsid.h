@@ -38,6 +38,18 @@
 */
 #define FSID_STATISTICS 1
 
+/**
+* Maximal length of strings kept inline in hash table slots instead of records, at most 255, 0 to keep every string in a record
+*/
+#ifndef FSID_INLINE_KEY_LENGTH
+#define FSID_INLINE_KEY_LENGTH 15
+#endif
+
+/**
+* Use instrumentation, define FSID_INSTRUMENTATION for fsid.c and its callers to keep per-thread operation counters and sample latencies
+*/
+/* #define FSID_INSTRUMENTATION 1 */
+
 /**
 * Result codes
 */
@@ -45,6 +57,32 @@
 #define FSID_ERR_INVALID_PARAM  (-1)
 #define FSID_ERR_OUT_OF_MEMORY  (-2)
 #define FSID_ERR_INVALID_VALUE  (-3)
+#define FSID_ERR_IO             (-4)
+#define FSID_ERR_INVALID_FORMAT (-5)
+#define FSID_ERR_READ_ONLY      (-6)
+#define FSID_ERR_HASH_FAILED    (-7)
+
+/**
+* Index engines
+*/
+#define FSID_ENGINE_TREE        (0) /*< AVL tree of hash buckets */
+#define FSID_ENGINE_HASHTABLE   (1) /*< Open-addressing hash table with SIMD-probed control bytes */
+#define FSID_ENGINE_FROZEN      (2) /*< Read-only image with minimal perfect hash, set by fsid_open_image, fsid_open_mapped and fsid_open_replica */
+
+/**
+* Broker flags
+*/
+#define FSID_FLAG_LOCKFREE_READERS   (0x00000001) /*< Checks take no lock, requires FSID_ENGINE_HASHTABLE */
+#define FSID_FLAG_EXTERNAL_LOCKING   (0x00000002) /*< Broker takes no lock and ignores lock callbacks, the caller serializes writers against readers and other writers */
+#define FSID_FLAG_LOCKFREE_WRITERS   (0x00000004) /*< Inserts take no lock and run concurrently, implies FSID_FLAG_LOCKFREE_READERS, not with FSID_FLAG_EXTERNAL_LOCKING or a bounded cache */
+#define FSID_FLAG_OPTIMISTIC_READERS (0x00000008) /*< Checks take no lock and are repeated if a writer changed the broker meanwhile, requires FSID_ENGINE_HASHTABLE, not with other lock flags or a bounded cache */
+#define FSID_FLAG_HUGE_PAGES         (0x00000010) /*< Blocks of 2 MB and more are backed by huge pages instead of allocFunc, the string arena grows by 2 MB chunks unless arenaChunkSize is given */
+
+/**
+* Sampled operations
+*/
+#define FSID_OPERATION_CHECK    (0) /*< Check of a string */
+#define FSID_OPERATION_INSERT   (1) /*< Insert of a string */
 
 #ifdef __cplusplus
 extern "C" {
@@ -79,6 +117,15 @@ extern "C" {
     */
     typedef uint32_t (FSID_CALLBACK *fsid_hash)(void* _userData, const char* _string, size_t _length);
 
+    /**
+    * User callback to 64-bit hash computation of _string data with _length bytes.
+    * @param _userData Private data passed from fsid_init_t.
+    * @param _string Pointer to byte string.
+    * @param _length Length the string in bytes.
+    * @return Hash value.
+    */
+    typedef uint64_t (FSID_CALLBACK *fsid_hash64)(void* _userData, const char* _string, size_t _length);
+
     /**
     * User callback to read-only lock the broker.
     * @param _userData Private data passed from fsid_init_t.
@@ -103,6 +150,52 @@ extern "C" {
     */
     typedef void (FSID_CALLBACK *fsid_rwunlock)(void* _userData);
 
+    /**
+    * User callback to write snapshot image data.
+    * @param _userData Private data passed to fsid_save.
+    * @param _data Pointer to data.
+    * @param _size Bytes to write.
+    * @return Number of bytes written, less than _size on failure.
+    */
+    typedef size_t (FSID_CALLBACK *fsid_write)(void* _userData, const void* _data, size_t _size);
+
+    /**
+    * User callback to read snapshot image data.
+    * @param _userData Private data passed to fsid_load.
+    * @param _data Pointer to buffer.
+    * @param _size Bytes to read.
+    * @return Number of bytes read, 0 on end of data or failure.
+    */
+    typedef size_t (FSID_CALLBACK *fsid_read)(void* _userData, void* _data, size_t _size);
+
+    /**
+    * User callback to receive the latency of a sampled operation, called by the thread that made the operation after the lock is released.
+    * @param _userData Private data passed to callbacks.
+    * @param _operation Operation FSID_OPERATION_*.
+    * @param _nanoseconds Duration of the operation.
+    * @param _lockNanoseconds Part of _nanoseconds spent to acquire the lock.
+    */
+    typedef void (FSID_CALLBACK *fsid_sample)(void* _userData, int _operation, uint64_t _nanoseconds, uint64_t _lockNanoseconds);
+
+    /**
+    * User callback to receive a string of the broker visited by fsid_foreach.
+    * @param _userData Private data passed to fsid_foreach.
+    * @param _value Value of the string.
+    * @param _string Pointer to byte string inside the broker, or the caller's pointer given to fsid_insert_external.
+    * @param _length Length of the string in bytes.
+    * @return 0 to continue, other value to stop the iteration.
+    */
+    typedef int (FSID_CALLBACK *fsid_visit)(void* _userData, int _value, const char* _string, size_t _length);
+
+    /**
+    * Position of fsid_iterate_next in the broker, zero-initialized before the first call.
+    */
+    typedef struct fsid_cursor_struct
+    {
+        uint32_t shard; /*< Shard of the next string */
+        int value;      /*< Value of the next string inside the shard */
+    } fsid_cursor_t;
+
     /**
     * Structure contains the parameters to initialize broker.
     */
@@ -116,10 +209,32 @@ extern "C" {
         fsid_rounlock   rounlockFunc;   /*< Used to read-only unlock internal state */
         fsid_rwlock     rwlockFunc;     /*< Used to read-write lock internal state */
         fsid_rwunlock   rwunlockFunc;   /*< Used to read-write unlock internal state */
+        int             engine;         /*< Index engine FSID_ENGINE_*, FSID_ENGINE_TREE by default */
+        size_t          arenaChunkSize; /*< Size in bytes of string arena chunks, 0 to use default */
+        size_t          arenaAlignment; /*< Alignment of records in string arena, power of two, 0 to use default */
+        uint32_t        flags;          /*< Combination of FSID_FLAG_* */
+        uint32_t        shardBits;      /*< Split broker into 1 << shardBits shards with own locks, shard index is stored in low bits of values, up to 8, 0 by default */
+        void* const*    shardUserData;  /*< Array of 1 << shardBits pointers passed to lock callbacks of each shard, can be NULL to pass userData */
+        size_t          threadCacheSize;/*< Number of entries in per-thread lookup cache, rounded up to power of two, 0 to disable */
+        fsid_hash64     hash64Func;     /*< Used to specific 64-bit hash function, takes precedence over hashFunc */
+        fsid_sample     sampleFunc;     /*< Receives latency of every sampleInterval-th check and insert of each thread, requires FSID_INSTRUMENTATION, can be NULL */
+        uint32_t        sampleInterval; /*< Operations per sample of each thread, 0 to use default 1024 */
+        size_t          maxEntries;     /*< Evict strings not checked or inserted again recently once the broker holds more strings, split evenly between shards, 0 for no limit */
+        size_t          maxBytes;       /*< Evict strings not checked or inserted again recently once their records take more bytes of string arena, split evenly between shards, 0 for no limit */
     } fsid_init_t;
 
     /**
     * Initialize broker with specific parameters.
+    * With maxEntries or maxBytes the broker is a bounded cache: inserts evict cold strings by the CLOCK policy, values carry an 8-bit generation
+    * so that values of evicted strings stay invalid until their slot is reused 256 times, and up to 1 << (23 - shardBits) strings fit in each shard.
+    * Pointers returned by fsid_check_value of a bounded broker stay valid only until the next insert may evict the string.
+    * With FSID_FLAG_LOCKFREE_WRITERS inserts claim hash table slots by compare-exchange and allocFunc must be thread-safe, other writers still take
+    * the read-write lock and wait for inserts in progress. Inserts racing on the same string may leave unused values, and values and memory
+    * of removed strings are not reused by them.
+    * With FSID_FLAG_OPTIMISTIC_READERS, which requires FSID_ENGINE_HASHTABLE, writers take the read-write lock and advance a sequence counter
+    * of the broker, checks read the counter before and after the lookup and take the read-only lock only for statistics and saving. Checks
+    * write no shared memory, a check waits while a writer holds the lock, and the table and arena chunks replaced by fsid_compact are retired
+    * and freed once no check started before the compaction is running.
     * @param _fsid Pointer to broker.
     * @param _params Pointer to fsid_init_t struct, can be NULL.
     * @return FSID_SUCCESSFUL if successful.
@@ -136,6 +251,15 @@ extern "C" {
     */
     FSID_EXTERN int FSID_API fsid_release(fsid_t _fsid);
 
+    /**
+    * Computes the broker hash of a byte string, to be cached by the caller and passed to fsid_check_hashed and fsid_insert_hashed.
+    * @param _fsid Broker.
+    * @param _string Pointer to byte string.
+    * @param _length Length the string in bytes.
+    * @return Hash value, 0 if _fsid is NULL or _string is NULL.
+    */
+    FSID_EXTERN uint64_t FSID_API fsid_hash_stringlen(fsid_t _fsid, const char* _string, size_t _length);
+
     /**
     * Checks if there is a null-terminated byte string contained in the broker.
     * @param _fsid Broker.
@@ -157,6 +281,31 @@ extern "C" {
     */
     FSID_EXTERN int FSID_API fsid_check_stringlen(fsid_t _fsid, const char* _string, size_t _length);
 
+    /**
+    * Checks if there is a byte string with precomputed hash contained in the broker.
+    * @param _fsid Broker.
+    * @param _string Pointer to byte string.
+    * @param _length Length the string in bytes.
+    * @param _hash Hash of the string returned by fsid_hash_stringlen, or any other hash used for this string with every *_hashed call.
+    * @return Non-negative value associated with this string, otherwise negative value.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL or _string is NULL.
+    *         FSID_ERR_INVALID_VALUE if this string is not contained in the broker.
+    */
+    FSID_EXTERN int FSID_API fsid_check_hashed(fsid_t _fsid, const char* _string, size_t _length, uint64_t _hash);
+
+    /**
+    * Checks an array of byte strings under a single lock, lookups of different strings are interleaved to overlap memory latency.
+    * @param _fsid Broker.
+    * @param _strings Array of _count pointers to byte strings.
+    * @param _lengths Array of _count string lengths in bytes, can be NULL if all strings are null-terminated.
+    * @param _count Number of strings.
+    * @param _values Array of _count integers to receive the value of each string,
+    *        FSID_ERR_INVALID_VALUE if the string is not contained in the broker or FSID_ERR_INVALID_PARAM if the string is NULL.
+    * @return FSID_SUCCESSFUL if successful.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL, _strings or _values is NULL, or some string is NULL.
+    */
+    FSID_EXTERN int FSID_API fsid_check_batch(fsid_t _fsid, const char* const* _strings, const size_t* _lengths, size_t _count, int* _values);
+
     /**
     * Inserts a null-terminated byte string into the broker, if the broker doesn't already contain an equivalent string.
     * @param _fsid Broker.
@@ -164,6 +313,7 @@ extern "C" {
     * @return Non-negative value associated with this string, otherwise negative value.
     *         FSID_ERR_INVALID_PARAM if _fsid is NULL or _string is NULL.
     *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_READ_ONLY if the broker is frozen and the string is not contained in it.
     */
     FSID_EXTERN int FSID_API fsid_insert_string(fsid_t _fsid, const char* _string);
 
@@ -175,30 +325,319 @@ extern "C" {
     * @return Non-negative value associated with this string, otherwise negative value.
     *         FSID_ERR_INVALID_PARAM if _fsid is NULL or _string is NULL.
     *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_READ_ONLY if the broker is frozen and the string is not contained in it.
     */
     FSID_EXTERN int FSID_API fsid_insert_stringlen(fsid_t _fsid, const char* _string, size_t _length);
 
+    /**
+    * Inserts a byte string with precomputed hash into the broker, if the broker doesn't already contain an equivalent string.
+    * @param _fsid Broker.
+    * @param _string Pointer to byte string.
+    * @param _length Length the string in bytes.
+    * @param _hash Hash of the string returned by fsid_hash_stringlen, or any other hash used for this string with every *_hashed call.
+    * @return Non-negative value associated with this string, otherwise negative value.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL or _string is NULL.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_READ_ONLY if the broker is frozen and the string is not contained in it.
+    */
+    FSID_EXTERN int FSID_API fsid_insert_hashed(fsid_t _fsid, const char* _string, size_t _length, uint64_t _hash);
+
+    /**
+    * Inserts a byte string into the broker without copying it, the broker keeps the _string pointer itself.
+    * The string memory must stay valid and unchanged until the broker is released, for example a buffer or a mapped file that outlives the broker.
+    * fsid_check_value returns this pointer, which is null-terminated only if the caller's buffer is.
+    * If the string is already contained in the broker, its value is returned and _string is not referenced.
+    * @param _fsid Broker.
+    * @param _string Pointer to byte string.
+    * @param _length Length the string in bytes.
+    * @return Non-negative value associated with this string, otherwise negative value.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL or _string is NULL.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_READ_ONLY if the broker is frozen and the string is not contained in it.
+    */
+    FSID_EXTERN int FSID_API fsid_insert_external(fsid_t _fsid, const char* _string, size_t _length);
+
+    /**
+    * Removes the string associated with the value, later inserts reuse the value and the memory of the string.
+    * Pointers returned by fsid_check_value for this value become invalid.
+    * Lock-free readers and per-thread caches never see reused memory, removed strings wait until every thread that could still access them finished its check.
+    * Strings longer than the free lists keep their memory until fsid_compact.
+    * @param _fsid Broker.
+    * @param _value Value of string.
+    * @return FSID_SUCCESSFUL if successful, otherwise negative value.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL.
+    *         FSID_ERR_INVALID_VALUE if _value is not associated with a string, the empty string can't be removed.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_READ_ONLY if the broker is frozen.
+    */
+    FSID_EXTERN int FSID_API fsid_remove_value(fsid_t _fsid, int _value);
+
+    /**
+    * Preallocates storage for strings about to be inserted, so the inserts take no allocations until the hint is exceeded.
+    * Without a hint storage grows geometrically as strings are inserted.
+    * @param _fsid Broker.
+    * @param _expectedStrings Number of strings expected to be inserted in addition to the contained ones.
+    * @param _expectedBytes Total length in bytes of these strings, 0 if they are inserted with fsid_insert_external.
+    * @return FSID_SUCCESSFUL if successful.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_READ_ONLY if the broker is frozen.
+    */
+    FSID_EXTERN int FSID_API fsid_reserve(fsid_t _fsid, size_t _expectedStrings, size_t _expectedBytes);
+
+    /**
+    * Rebuilds the index into contiguous memory for a read-heavy phase after bulk loading.
+    * Tree nodes are laid out level by level as a balanced tree, hash table gets the minimal capacity, and strings are packed in the index order.
+    * Values are kept. Pointers returned by fsid_check_value before the call become invalid unless the strings were inserted with fsid_insert_external,
+    * the broker has lock-free readers or thread caches, those keep the old memory until release.
+    * Later inserts are allowed and grow storage again.
+    * @param _fsid Broker.
+    * @return FSID_SUCCESSFUL if successful, frozen broker is already compact.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory, the broker is left unchanged.
+    */
+    FSID_EXTERN int FSID_API fsid_compact(fsid_t _fsid);
+
+    /**
+    * Inserts an array of byte strings into the broker under a single lock, strings already contained in the broker are not duplicated.
+    * Strings are hashed before locking and processed in hash order, so values of new strings are assigned in that order rather than in array order.
+    * @param _fsid Broker.
+    * @param _strings Array of _count pointers to byte strings.
+    * @param _lengths Array of _count string lengths in bytes, can be NULL if all strings are null-terminated.
+    * @param _count Number of strings.
+    * @param _values Array of _count integers to receive the value or the negative result code of each string.
+    * @return FSID_SUCCESSFUL if all strings are inserted, otherwise negative result code of a failed string.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL, _strings or _values is NULL, or some string is NULL.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_READ_ONLY if the broker is frozen and the string is not contained in it.
+    */
+    FSID_EXTERN int FSID_API fsid_insert_batch(fsid_t _fsid, const char* const* _strings, const size_t* _lengths, size_t _count, int* _values);
+
+    /**
+    * Splits a buffer into fields separated by any of the delimiter bytes and inserts the fields into the broker under a single lock.
+    * Fields are scanned and hashed in place, only new fields are copied into the broker, empty fields receive value 0.
+    * @param _fsid Broker.
+    * @param _buffer Pointer to buffer, not necessarily null-terminated.
+    * @param _length Length of the buffer in bytes, an empty buffer has no fields.
+    * @param _delimiters Null-terminated set of delimiter bytes.
+    * @param _values Array of _maxValues integers to receive the value or the negative result code of each field in buffer order.
+    * @param _maxValues Maximum number of fields to insert, further fields are only counted.
+    * @return Number of fields in the buffer, greater than _maxValues if not all fields are inserted, otherwise negative result code.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL, _buffer is NULL, _delimiters is NULL or empty, or _values is NULL while _maxValues is not 0.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    */
+    FSID_EXTERN int FSID_API fsid_intern_split(fsid_t _fsid, const char* _buffer, size_t _length, const char* _delimiters, int* _values, size_t _maxValues);
+
+    /**
+    * Inserts all strings of the source broker into the destination broker, so that brokers built by separate threads can be joined afterwards.
+    * Strings are inserted in order of their source values, merging into an empty broker assigns dense values. Strings already contained
+    * in the destination keep their values, strings inserted into the source with fsid_insert_external are copied.
+    * The source is locked against writers during the merge, the two brokers must not share locks.
+    * @param _dst Destination broker.
+    * @param _src Source broker, can be frozen.
+    * @param _remap Array of _remapSize integers to receive the destination value or the negative result code at the index of each source value,
+    *               FSID_ERR_INVALID_VALUE at indices of unused values, can be NULL. The number of strings inserted into a source without shards
+    *               and removals plus one is enough.
+    * @param _remapSize Number of integers in _remap, greater than the largest value of a source string.
+    * @return FSID_SUCCESSFUL if all strings are inserted, otherwise negative result code of a failed string.
+    *         FSID_ERR_INVALID_PARAM if _dst or _src is NULL, both are the same broker, or _remap is too small, nothing is inserted then.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_READ_ONLY if the destination broker is frozen.
+    */
+    FSID_EXTERN int FSID_API fsid_merge(fsid_t _dst, fsid_t _src, int* _remap, size_t _remapSize);
+
     /**
     * Checks if there is a value associated with the string in the broker.
     * @param _fsid Broker.
     * @param _value Value.
-    * @param _pointer Pointer to byte string pointer to receive null-terminated string that associated with the value, can be NULL.
+    * @param _pointer Pointer to byte string pointer to receive null-terminated string that associated with the value, or the caller's pointer given to fsid_insert_external, can be NULL.
     * @param _length Pointer to size_t to receive string length that associated with the value, can be NULL.
     * @return FSID_SUCCESSFUL if successful.
     *         FSID_ERR_INVALID_PARAM if _fsid is NULL.
-    *         FSID_ERR_INVALID_VALUE if _value is not associated with the string in the broker.
+    *         FSID_ERR_INVALID_VALUE if _value is not associated with the string in the broker, or its string was evicted or removed.
     */
     FSID_EXTERN int FSID_API fsid_check_value(fsid_t _fsid, int _value, const char** _pointer, size_t* _length);
 
+    /**
+    * Visits all strings of the broker in a single pass over the value table, in value order shard by shard, the empty string is not visited.
+    * The broker is locked against writers during the pass, _visitFunc must not modify it.
+    * @param _fsid Broker.
+    * @param _visitFunc Callback receiving value, pointer and length of each string.
+    * @param _userData Private data passed to _visitFunc.
+    * @return FSID_SUCCESSFUL if all strings are visited, otherwise the value returned by _visitFunc to stop.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL or _visitFunc is NULL.
+    */
+    FSID_EXTERN int FSID_API fsid_foreach(fsid_t _fsid, fsid_visit _visitFunc, void* _userData);
+
+    /**
+    * Stores the next strings of the broker in the order of fsid_foreach, the read-only lock is taken per call and shard so writers can proceed between calls.
+    * Strings inserted between calls are returned if their values come after the cursor, removed strings are not returned anymore.
+    * Pointers stay valid as long as those returned by fsid_check_value.
+    * With FSID_FLAG_LOCKFREE_WRITERS inserts are stopped per call and shard like by fsid_foreach.
+    * @param _fsid Broker.
+    * @param _cursor Position to continue from, advanced past the returned strings.
+    * @param _values Array of _maxCount integers to receive the values.
+    * @param _pointers Array of _maxCount pointers to receive the strings, can be NULL.
+    * @param _lengths Array of _maxCount integers to receive the string lengths, can be NULL.
+    * @param _maxCount Maximum number of strings to return.
+    * @return Number of stored strings, 0 once all strings are returned, otherwise negative result code.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL, _cursor is NULL or _values is NULL.
+    */
+    FSID_EXTERN int FSID_API fsid_iterate_next(fsid_t _fsid, fsid_cursor_t* _cursor, int* _values, const char** _pointers, size_t* _lengths, size_t _maxCount);
+
+    /**
+    * Writes a snapshot image of the broker: strings with their values and hashes in value order.
+    * Writers are blocked while the image is written.
+    * @param _fsid Broker.
+    * @param _writeFunc Callback to write image data.
+    * @param _userData Private data passed to _writeFunc.
+    * @return FSID_SUCCESSFUL if successful.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL or _writeFunc is NULL.
+    *         FSID_ERR_IO if _writeFunc fails.
+    */
+    FSID_EXTERN int FSID_API fsid_save(fsid_t _fsid, fsid_write _writeFunc, void* _userData);
+
+    /**
+    * Writes a snapshot image of the broker to the file.
+    * @param _fsid Broker.
+    * @param _path Path to the file, replaced if exists.
+    * @return FSID_SUCCESSFUL if successful.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL or _path is NULL.
+    *         FSID_ERR_IO if the file cannot be written.
+    */
+    FSID_EXTERN int FSID_API fsid_save_file(fsid_t _fsid, const char* _path);
+
+    /**
+    * Initialize broker with specific parameters and fill it from a snapshot image written by fsid_save, every string keeps its value.
+    * Stored hashes are reused when the image was written with the same hash function, otherwise strings are rehashed.
+    * With shardBits the values must route to the same shards as when the image was written.
+    * Images of bounded brokers load only into bounded brokers and the other way around, strings beyond the budget are evicted by later inserts
+    * and values of strings evicted before the save may be reused with their old generation.
+    * @param _fsid Pointer to broker, receives NULL on failure.
+    * @param _params Pointer to fsid_init_t struct, can be NULL.
+    * @param _readFunc Callback to read image data.
+    * @param _userData Private data passed to _readFunc.
+    * @return FSID_SUCCESSFUL if successful.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL, _readFunc is NULL or invalid parameters in _params.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_IO if _readFunc fails or the image is truncated.
+    *         FSID_ERR_INVALID_FORMAT if the image is not valid or does not fit _params.
+    */
+    FSID_EXTERN int FSID_API fsid_load(fsid_t* _fsid, const fsid_init_t* _params, fsid_read _readFunc, void* _userData);
+
+    /**
+    * Initialize broker with specific parameters and fill it from a snapshot image file written by fsid_save_file.
+    * @param _fsid Pointer to broker, receives NULL on failure.
+    * @param _params Pointer to fsid_init_t struct, can be NULL.
+    * @param _path Path to the file.
+    * @return Same as fsid_load, FSID_ERR_IO if the file cannot be opened.
+    */
+    FSID_EXTERN int FSID_API fsid_load_file(fsid_t* _fsid, const fsid_init_t* _params, const char* _path);
+
+    /**
+    * Writes a frozen image of the broker: a minimal perfect hash, contiguous null-terminated strings and a value to string table.
+    * The image keeps every value and can be used in place by fsid_open_image or fsid_open_mapped.
+    * Writers are blocked while the image is built and written.
+    * @param _fsid Broker, not frozen.
+    * @param _writeFunc Callback to write image data.
+    * @param _userData Private data passed to _writeFunc.
+    * @return FSID_SUCCESSFUL if successful.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL, frozen or contains a string longer than 4 GB, or _writeFunc is NULL.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_IO if _writeFunc fails.
+    *         FSID_ERR_HASH_FAILED if no seed gives a minimal perfect hash of the strings.
+    */
+    FSID_EXTERN int FSID_API fsid_freeze(fsid_t _fsid, fsid_write _writeFunc, void* _userData);
+
+    /**
+    * Writes a frozen image of the broker to the file.
+    * @param _fsid Broker, not frozen.
+    * @param _path Path to the file, replaced if exists.
+    * @return Same as fsid_freeze, FSID_ERR_HASH_FAILED if no seed gives a minimal perfect hash of the strings, FSID_ERR_IO if the file cannot be written.
+    */
+    FSID_EXTERN int FSID_API fsid_freeze_file(fsid_t _fsid, const char* _path);
+
+    /**
+    * Opens a frozen image written by fsid_freeze as a read-only broker with FSID_ENGINE_FROZEN.
+    * Lookups read the image in place and take no locks, inserts of new strings return FSID_ERR_READ_ONLY.
+    * Only userData, allocFunc and freeFunc of _params are used, the image defines its own hash function.
+    * @param _fsid Pointer to broker, receives NULL on failure.
+    * @param _params Pointer to fsid_init_t struct, can be NULL.
+    * @param _data Pointer to image, must stay valid and unchanged until the broker is released.
+    * @param _size Size of image in bytes.
+    * @return FSID_SUCCESSFUL if successful.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL, _data is NULL or invalid parameters in _params.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_INVALID_FORMAT if the image is not valid.
+    */
+    FSID_EXTERN int FSID_API fsid_open_image(fsid_t* _fsid, const fsid_init_t* _params, const void* _data, size_t _size);
+
+    /**
+    * Opens a frozen image file written by fsid_freeze_file as a read-only broker, the file is memory-mapped and unmapped on release.
+    * Pages of the file are shared by all processes opening it, on platforms without memory mapping the file is read into memory.
+    * @param _fsid Pointer to broker, receives NULL on failure.
+    * @param _params Pointer to fsid_init_t struct, can be NULL.
+    * @param _path Path to the file.
+    * @return Same as fsid_open_image, FSID_ERR_IO if the file cannot be opened or mapped.
+    */
+    FSID_EXTERN int FSID_API fsid_open_mapped(fsid_t* _fsid, const fsid_init_t* _params, const char* _path);
+
+    /**
+    * Opens a read-only replica of the broker: its frozen image copied into memory from allocFunc of _params.
+    * A NUMA system keeps one replica per node, opened with an allocFunc taking memory of the node or by a thread running on it,
+    * the caller routes readers of each node to its replica.
+    * The image is built by fsid_freeze in time linear in the number of strings, writers of _fsid are blocked meanwhile.
+    * Only userData, allocFunc, freeFunc and FSID_FLAG_HUGE_PAGES of _params are used.
+    * @param _replica Pointer to replica, receives NULL on failure.
+    * @param _params Pointer to fsid_init_t struct, can be NULL.
+    * @param _fsid Source broker, not frozen.
+    * @return FSID_SUCCESSFUL if successful.
+    *         FSID_ERR_INVALID_PARAM if _replica is NULL, _fsid is NULL or frozen, or invalid parameters in _params.
+    *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+    *         FSID_ERR_HASH_FAILED if no seed gives a minimal perfect hash of the strings.
+    */
+    FSID_EXTERN int FSID_API fsid_open_replica(fsid_t* _replica, const fsid_init_t* _params, fsid_t _fsid);
+
+    /**
+    * Opens a new replica if strings were inserted into or removed from the source broker since _replica was opened.
+    * The new replica takes memory from the same allocFunc, _replica is not changed and is released by the caller once its readers switched.
+    * The refresh is not incremental: the whole image is rebuilt like by fsid_open_replica, blocking writers of _fsid in time linear in the
+    * number of strings, refresh replicas once per batch of changes rather than after every insert.
+    * @param _refreshed Pointer to new replica, receives NULL if _replica is up to date or on failure.
+    * @param _replica Replica opened by fsid_open_replica or fsid_refresh_replica.
+    * @param _fsid Source broker of _replica.
+    * @return Same as fsid_open_replica, FSID_ERR_INVALID_PARAM if _replica is not a replica of _fsid, also if _fsid is another broker
+    *         at the address of a released source.
+    */
+    FSID_EXTERN int FSID_API fsid_refresh_replica(fsid_t* _refreshed, fsid_t _replica, fsid_t _fsid);
+
 #ifdef FSID_STATISTICS
     /**
-    * Contains the broker statistics.
+    * Number of chain length buckets in statistics.
+    */
+#define FSID_STATISTICS_CHAIN_BUCKETS (8)
+
+    /**
+    * Contains the broker statistics, all counters are maintained on insert and removal so getting them takes constant time.
     */
     typedef struct fsid_statistics_struct
     {
         size_t memorySize;  /*< Memory used */
         size_t hashesCount; /*< Number of hashes in broker */
         size_t valuesCount; /*< Number of associated strings in broker */
+        size_t arenaSlack;  /*< Bytes of memorySize reserved by string arena but not used by strings, including memory of removed strings */
+        size_t cacheHits;   /*< Number of checks and inserts resolved by per-thread lookup caches */
+        size_t cacheMisses; /*< Number of checks and inserts missed in per-thread lookup caches */
+        size_t indexDepth;  /*< Levels of the tree, or longest probe sequence in groups of the hash table, the deepest shard with shards */
+        size_t chainHistogram[FSID_STATISTICS_CHAIN_BUCKETS]; /*< Tree hashes by record chain length 1, 2-3, 4-7 and so on up to 128 and more, hash table strings by probed groups in the same buckets */
+        size_t stringBytes;     /*< Bytes of contained strings including external strings, without terminators */
+        size_t overheadBytes;   /*< Bytes of memorySize not used by copies of strings and their terminators */
+        size_t arenaSize;       /*< Bytes of string arena chunks, arenaSlack of them not used */
+        size_t nodesCapacity;   /*< Tree nodes allocated in node pools, hashesCount of them used */
+        size_t tableCapacity;   /*< Slots of hash table, hashesCount of them used */
+        size_t allocCount;      /*< Number of allocFunc calls since the broker was initialized */
+        size_t evictions;       /*< Number of strings evicted by bounded broker since it was initialized */
+        size_t hugePagesDenied; /*< Number of blocks with FSID_FLAG_HUGE_PAGES the system refused huge pages for */
     } fsid_statistics_t;
 
     /**
@@ -211,6 +650,31 @@ extern "C" {
     FSID_EXTERN int FSID_API fsid_get_statistics(fsid_statistics_t* _stat, const fsid_t _fsid);
 #endif /* FSID_STATISTICS */
 
+#ifdef FSID_INSTRUMENTATION
+    /**
+    * Contains the operation counters of the broker summed over threads, each thread counts its own operations without sharing cache lines.
+    */
+    typedef struct fsid_counters_struct
+    {
+        uint64_t checks;            /*< Number of checked strings, including batches */
+        uint64_t checkMisses;       /*< Number of checked strings not contained in the broker */
+        uint64_t inserts;           /*< Number of inserted strings, including batches and split fields */
+        uint64_t probeSteps;        /*< Tree nodes, chain records and hash table groups visited by single checks and inserts */
+        uint64_t samples;           /*< Number of sampled operations */
+        uint64_t sampleNanoseconds; /*< Total duration of sampled operations */
+        uint64_t lockNanoseconds;   /*< Part of sampleNanoseconds spent to acquire locks */
+    } fsid_counters_t;
+
+    /**
+    * Get the operation counters of the broker.
+    * @param _counters Pointer to the counters structure.
+    * @param _fsid Broker.
+    * @return FSID_SUCCESSFUL if successful.
+    *         FSID_ERR_INVALID_PARAM if _fsid is NULL or _counters is NULL.
+    */
+    FSID_EXTERN int FSID_API fsid_get_counters(fsid_counters_t* _counters, const fsid_t _fsid);
+#endif /* FSID_INSTRUMENTATION */
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
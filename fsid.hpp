@@ -0,0 +1,769 @@
+/*
+ * Fast string identifier, C++ interface
+ * -----------------------------------------------------------------------------
+ *
+ * Copyright(c) 2021 Alexandr Murashko.
+ * Licensed under the MIT license.
+ */
+
+#ifndef FSID_HPP_INCLUDE
+#define FSID_HPP_INCLUDE
+
+/* Shared locks, string views and if constexpr of the interface need C++17, MSVC reports it in _MSVC_LANG */
+#if (defined(_MSVC_LANG) ? _MSVC_LANG : __cplusplus) < 201703L
+#error "fsid.hpp requires C++17"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/**
+* glibc declares fsid_t of statfs in <sys/types.h> for C++, the broker type is seen as fsid_handle_t here,
+* include fsid.hpp instead of fsid.h in C++ translation units.
+*/
+#define fsid_t fsid_handle_t
+#include "fsid.h"
+#undef fsid_t
+
+namespace fsid
+{
+    /**
+    * Hash policy that keeps the broker's own hash function, strings are hashed inside the library.
+    * A custom hash policy is a default constructible type with uint64_t operator()(std::string_view) const,
+    * it is inlined into lookups of fsid::broker and also installed as hash64Func of the underlying broker.
+    */
+    struct default_hash
+    {
+    };
+
+    /**
+    * Lock policy that takes no lock and compiles out, the broker must not be shared between threads without outer synchronization.
+    * A custom lock policy provides lock, unlock, lock_shared and unlock_shared.
+    */
+    struct null_lock
+    {
+        void lock() noexcept {}
+        void unlock() noexcept {}
+        void lock_shared() noexcept {}
+        void unlock_shared() noexcept {}
+    };
+
+    /**
+    * Lock policy that serializes readers and writers with one mutex.
+    */
+    class mutex_lock
+    {
+    public:
+        void lock() { mutex.lock(); }
+        void unlock() { mutex.unlock(); }
+        void lock_shared() { mutex.lock(); }
+        void unlock_shared() { mutex.unlock(); }
+
+    private:
+        std::mutex mutex;
+    };
+
+    /**
+    * Lock policy that lets readers run concurrently and serializes writers.
+    */
+    class shared_lock
+    {
+    public:
+        void lock() { mutex.lock(); }
+        void unlock() { mutex.unlock(); }
+        void lock_shared() { mutex.lock_shared(); }
+        void unlock_shared() { mutex.unlock_shared(); }
+
+    private:
+        std::shared_mutex mutex;
+    };
+
+    /**
+    * Allocation policy that keeps the broker's own allocator.
+    * A custom allocation policy is a default constructible type with void* allocate(std::size_t) and void deallocate(void*).
+    */
+    struct default_alloc
+    {
+    };
+
+    /**
+    * Exception thrown when a broker cannot be created, code() returns the FSID_ERR_* result code.
+    */
+    class error : public std::runtime_error
+    {
+    public:
+        explicit error(int _code)
+            : std::runtime_error(_code == FSID_ERR_OUT_OF_MEMORY ? "fsid: out of memory" :
+                                 _code == FSID_ERR_IO ? "fsid: input/output error" :
+                                 _code == FSID_ERR_INVALID_FORMAT ? "fsid: invalid image format" : "fsid: invalid parameter")
+            , errorCode(_code)
+        {
+        }
+
+        int code() const noexcept { return errorCode; }
+
+    private:
+        int errorCode;
+    };
+
+    namespace detail
+    {
+        /* Empty lock policies are stored in place, others on the heap so the broker stays movable */
+        template <class Lock, bool = std::is_empty<Lock>::value>
+        class lock_holder : private Lock
+        {
+        public:
+            Lock& lock() const noexcept { return const_cast<lock_holder&>(*this); }
+        };
+
+        template <class Lock>
+        class lock_holder<Lock, false>
+        {
+        public:
+            lock_holder() : object(new Lock()) {}
+            lock_holder(lock_holder&& _other) noexcept : object(std::exchange(_other.object, nullptr)) {}
+            lock_holder& operator=(lock_holder&& _other) noexcept { std::swap(object, _other.object); return *this; }
+            ~lock_holder() { delete object; }
+
+            Lock& lock() const noexcept { return *object; }
+
+        private:
+            Lock* object;
+        };
+
+        /* Scoped exclusive lock */
+        template <class Lock>
+        class unique_guard
+        {
+        public:
+            explicit unique_guard(Lock& _lock) : lock(_lock) { lock.lock(); }
+            ~unique_guard() { lock.unlock(); }
+            unique_guard(const unique_guard&) = delete;
+            unique_guard& operator=(const unique_guard&) = delete;
+
+        private:
+            Lock& lock;
+        };
+
+        /* Scoped shared lock */
+        template <class Lock>
+        class shared_guard
+        {
+        public:
+            explicit shared_guard(Lock& _lock) : lock(_lock) { lock.lock_shared(); }
+            ~shared_guard() { lock.unlock_shared(); }
+            shared_guard(const shared_guard&) = delete;
+            shared_guard& operator=(const shared_guard&) = delete;
+
+        private:
+            Lock& lock;
+        };
+
+        /* Empty views may have no data pointer, the library rejects NULL strings */
+        inline const char* data(std::string_view _string) noexcept
+        {
+            return _string.data() ? _string.data() : "";
+        }
+
+        /* Constants of the default hash in fsid.c */
+        constexpr std::uint64_t hashSeed = 0xa0761d6478bd642full;
+        constexpr std::uint64_t hashSecret0 = 0xe7037ed1a0b428dbull;
+        constexpr std::uint64_t hashSecret1 = 0x8ebc6af09c88c6e3ull;
+        constexpr std::uint64_t hashSecret2 = 0x589965cc75374cc3ull;
+        constexpr std::size_t hashLongLength = 256;
+
+        /* Little-endian read of _size bytes */
+        constexpr std::uint64_t read(std::string_view _string, std::size_t _offset, std::size_t _size)
+        {
+            std::uint64_t value = 0;
+
+            for (std::size_t index = 0; index < _size; ++index)
+                value |= (std::uint64_t)(unsigned char)_string[_offset + index] << (index * 8);
+
+            return value;
+        }
+
+        /* Full 128-bit product of _a and _b, low half to _a and high half to _b */
+        constexpr void mum(std::uint64_t& _a, std::uint64_t& _b)
+        {
+            const std::uint64_t ha = _a >> 32, hb = _b >> 32, la = (std::uint32_t)_a, lb = (std::uint32_t)_b;
+            const std::uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+            const std::uint64_t t = rl + (rm0 << 32);
+            const std::uint64_t low = t + (rm1 << 32);
+            _b = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (low < t);
+            _a = low;
+        }
+
+        constexpr std::uint64_t mix(std::uint64_t _a, std::uint64_t _b)
+        {
+            mum(_a, _b);
+            return _a ^ _b;
+        }
+    } /* namespace detail */
+
+    /**
+    * Compile-time hash equal to fsid_hash_stringlen of a broker without custom hash function, for strings shorter than 256 bytes.
+    * @param _string String, a longer string fails constant evaluation and throws std::length_error at run time.
+    * @return Hash value to pass to fsid_check_hashed and fsid_insert_hashed.
+    */
+    constexpr std::uint64_t hash(std::string_view _string)
+    {
+        const std::size_t length = _string.size();
+        std::uint64_t seed = detail::hashSeed;
+        std::uint64_t a = 0;
+        std::uint64_t b = 0;
+
+        if (length >= detail::hashLongLength)
+            throw std::length_error("fsid: string is too long for compile-time hash");
+
+        if (length <= 16)
+        {
+            if (length >= 4)
+            {
+                const std::size_t offset = (length >> 3) << 2;
+
+                a = (detail::read(_string, 0, 4) << 32) | detail::read(_string, offset, 4);
+                b = (detail::read(_string, length - 4, 4) << 32) | detail::read(_string, length - 4 - offset, 4);
+            }
+            else if (length > 0)
+            {
+                a = ((std::uint64_t)(unsigned char)_string[0] << 16) | ((std::uint64_t)(unsigned char)_string[length >> 1] << 8) | (unsigned char)_string[length - 1];
+            }
+        }
+        else
+        {
+            std::uint64_t seed1 = seed;
+            std::size_t offset = 0;
+            std::size_t left = length;
+
+            while (left > 32)
+            {
+                seed = detail::mix(detail::read(_string, offset, 8) ^ detail::hashSecret0, detail::read(_string, offset + 8, 8) ^ seed);
+                seed1 = detail::mix(detail::read(_string, offset + 16, 8) ^ detail::hashSecret1, detail::read(_string, offset + 24, 8) ^ seed1);
+                offset += 32;
+                left -= 32;
+            }
+
+            seed ^= seed1;
+
+            if (left > 16)
+                seed = detail::mix(detail::read(_string, offset, 8) ^ detail::hashSecret0, detail::read(_string, offset + 8, 8) ^ seed);
+
+            a = detail::read(_string, offset + left - 16, 8);
+            b = detail::read(_string, offset + left - 8, 8);
+        }
+
+        a ^= detail::hashSecret0;
+        b ^= seed;
+        detail::mum(a, b);
+        return detail::mix(a ^ detail::hashSecret2 ^ length, b ^ detail::hashSecret0);
+    }
+
+    /**
+    * Compile-time table of well-known strings, the string at index i gets value i + 1 in a broker seeded with it.
+    * Strings must be unique, not empty and shorter than 256 bytes, otherwise constant evaluation fails.
+    */
+    template <std::size_t N>
+    class dictionary
+    {
+    public:
+        constexpr explicit dictionary(const std::string_view (&_keys)[N])
+            : keys()
+            , hashes()
+        {
+            for (std::size_t index = 0; index < N; ++index)
+            {
+                if (_keys[index].empty())
+                    throw std::invalid_argument("fsid: empty string in dictionary");
+
+                for (std::size_t other = 0; other < index; ++other)
+                {
+                    if (_keys[other] == _keys[index])
+                        throw std::invalid_argument("fsid: duplicate string in dictionary");
+                }
+
+                keys[index] = _keys[index];
+                hashes[index] = fsid::hash(_keys[index]);
+            }
+        }
+
+        /**
+        * Value of the string in a seeded broker, a string not in the dictionary fails constant evaluation and throws std::out_of_range at run time.
+        */
+        constexpr int id(std::string_view _key) const
+        {
+            for (std::size_t index = 0; index < N; ++index)
+            {
+                if (keys[index] == _key)
+                    return (int)index + 1;
+            }
+
+            throw std::out_of_range("fsid: string is not in dictionary");
+        }
+
+        constexpr std::size_t size() const noexcept { return N; }
+        constexpr std::string_view key(std::size_t _index) const { return keys[_index]; }
+        constexpr std::uint64_t hash(std::size_t _index) const { return hashes[_index]; }
+
+    private:
+        std::string_view keys[N];
+        std::uint64_t hashes[N];
+    };
+
+    /**
+    * Builds a dictionary from a braced list of string literals, for example constexpr auto keys = fsid::make_dictionary({"id", "name"}).
+    */
+    template <std::size_t N>
+    constexpr dictionary<N> make_dictionary(const std::string_view (&_keys)[N])
+    {
+        return dictionary<N>(_keys);
+    }
+
+    /**
+    * RAII owner of a broker with hash, lock and allocation policies resolved at compile time.
+    * The underlying broker is created with FSID_FLAG_EXTERNAL_LOCKING and all locking is done by the Lock policy,
+    * so lookups make no lock callbacks, and no hash callback either with a custom Hash policy.
+    * The broker is move-only, a moved-from broker can only be destroyed or assigned.
+    */
+    template <class Hash = default_hash, class Lock = null_lock, class Alloc = default_alloc>
+    class broker
+    {
+    public:
+        /**
+        * Create broker.
+        * @param _params Engine, arena, shard and cache parameters, callbacks are replaced by the policies and flags get FSID_FLAG_EXTERNAL_LOCKING.
+        * @throw fsid::error if the broker cannot be created.
+        */
+        explicit broker(const fsid_init_t& _params = fsid_init_t())
+        {
+            const fsid_init_t params = prepare(_params);
+            check_result(fsid_initialize(&handle, &params));
+            shardBits = params.shardBits;
+        }
+
+        /**
+        * Create broker seeded with a dictionary, see seed.
+        * @param _dictionary Dictionary of well-known strings.
+        * @param _params Same as above, shardBits must be 0.
+        * @throw fsid::error if the broker cannot be created or seeded.
+        */
+        template <std::size_t N>
+        explicit broker(const dictionary<N>& _dictionary, const fsid_init_t& _params = fsid_init_t())
+            : broker(_params)
+        {
+            check_result(seed(_dictionary));
+        }
+
+        /**
+        * Fill broker from a snapshot image file written by fsid_save_file or save_file.
+        * @param _path Path to the file.
+        * @param _params Same as for the constructor.
+        * @throw fsid::error if the image cannot be loaded.
+        */
+        static broker load_file(const char* _path, const fsid_init_t& _params = fsid_init_t())
+        {
+            const fsid_init_t params = prepare(_params);
+            fsid_handle_t loaded = nullptr;
+            check_result(fsid_load_file(&loaded, &params, _path));
+
+            broker result(loaded);
+            result.shardBits = params.shardBits;
+            return result;
+        }
+
+        /**
+        * Open frozen image file written by fsid_freeze_file or freeze_file as a read-only broker, the file is memory-mapped.
+        * The image defines its own hash function, so lookups are hashed by the library whatever the Hash policy is.
+        * @param _path Path to the file.
+        * @throw fsid::error if the image cannot be opened.
+        */
+        static broker open_mapped(const char* _path)
+        {
+            const fsid_init_t params = prepare(fsid_init_t());
+            fsid_handle_t opened = nullptr;
+            check_result(fsid_open_mapped(&opened, &params, _path));
+
+            broker result(opened);
+            result.frozen = true;
+            return result;
+        }
+
+        /**
+        * Open a read-only replica of the broker, see fsid_open_replica, its memory comes from the Alloc policy.
+        * @throw fsid::error if the replica cannot be opened.
+        */
+        broker open_replica() const
+        {
+            const fsid_init_t params = prepare(fsid_init_t());
+            fsid_handle_t opened = nullptr;
+            {
+                detail::shared_guard<Lock> guard(locks.lock());
+                check_result(fsid_open_replica(&opened, &params, handle));
+            }
+
+            broker result(opened);
+            result.frozen = true;
+            return result;
+        }
+
+        /**
+        * Replace _replica by a new one if strings were inserted or removed since it was opened, see fsid_refresh_replica.
+        * Readers of the previous replica must be done with it.
+        * @return Same as fsid_refresh_replica.
+        */
+        int refresh_replica(broker& _replica) const
+        {
+            fsid_handle_t refreshed = nullptr;
+            int result;
+            {
+                detail::shared_guard<Lock> guard(locks.lock());
+                result = fsid_refresh_replica(&refreshed, _replica.handle, handle);
+            }
+
+            if (refreshed)
+            {
+                broker next(refreshed);
+                next.frozen = true;
+                _replica = std::move(next);
+            }
+
+            return result;
+        }
+
+        broker(broker&& _other) noexcept
+            : handle(std::exchange(_other.handle, nullptr))
+            , frozen(_other.frozen)
+            , shardBits(_other.shardBits)
+            , locks(std::move(_other.locks))
+        {
+        }
+
+        broker& operator=(broker&& _other) noexcept
+        {
+            std::swap(handle, _other.handle);
+            std::swap(frozen, _other.frozen);
+            std::swap(shardBits, _other.shardBits);
+            locks = std::move(_other.locks);
+            return *this;
+        }
+
+        broker(const broker&) = delete;
+        broker& operator=(const broker&) = delete;
+
+        ~broker()
+        {
+            if (handle)
+                fsid_release(handle);
+        }
+
+        /**
+        * Checks if the string is contained in the broker.
+        * @return Non-negative value associated with this string, otherwise FSID_ERR_INVALID_VALUE.
+        */
+        int check(std::string_view _string) const
+        {
+            detail::shared_guard<Lock> guard(locks.lock());
+
+            if constexpr (!std::is_same<Hash, default_hash>::value)
+            {
+                if (!frozen)
+                    return fsid_check_hashed(handle, detail::data(_string), _string.size(), Hash()(_string));
+            }
+
+            return fsid_check_stringlen(handle, detail::data(_string), _string.size());
+        }
+
+        /**
+        * Inserts the string into the broker, if the broker doesn't already contain it.
+        * @return Non-negative value associated with this string, otherwise negative result code of fsid_insert_stringlen.
+        */
+        int insert(std::string_view _string)
+        {
+            detail::unique_guard<Lock> guard(locks.lock());
+
+            if constexpr (!std::is_same<Hash, default_hash>::value)
+            {
+                if (!frozen)
+                    return fsid_insert_hashed(handle, detail::data(_string), _string.size(), Hash()(_string));
+            }
+
+            return fsid_insert_stringlen(handle, detail::data(_string), _string.size());
+        }
+
+        /**
+        * Inserts the dictionary strings in order into an empty broker so that each string gets its dictionary id, FSID_ID values then agree with check and check_value.
+        * Seeding again with the same dictionary succeeds without changes.
+        * Hashes are taken from the dictionary with the default Hash policy, so known strings are not hashed at run time.
+        * @param _dictionary Dictionary of well-known strings.
+        * @return FSID_SUCCESSFUL if successful.
+        *         FSID_ERR_INVALID_PARAM if the broker has shards or some string gets another value because the broker was not empty or is bounded, preceding strings stay inserted.
+        *         FSID_ERR_OUT_OF_MEMORY if not enough of free memory.
+        *         FSID_ERR_READ_ONLY if the broker is frozen.
+        */
+        template <std::size_t N>
+        int seed(const dictionary<N>& _dictionary)
+        {
+            detail::unique_guard<Lock> guard(locks.lock());
+
+            if (frozen)
+                return FSID_ERR_READ_ONLY;
+
+            if (shardBits)
+                return FSID_ERR_INVALID_PARAM;
+
+            for (std::size_t index = 0; index < N; ++index)
+            {
+                const std::string_view key = _dictionary.key(index);
+                int value;
+
+                if constexpr (std::is_same<Hash, default_hash>::value)
+                    value = fsid_insert_hashed(handle, key.data(), key.size(), _dictionary.hash(index));
+                else
+                    value = fsid_insert_hashed(handle, key.data(), key.size(), Hash()(key));
+
+                if (value < 0)
+                    return value;
+
+                if (value != (int)index + 1)
+                    return FSID_ERR_INVALID_PARAM;
+            }
+
+            return FSID_SUCCESSFUL;
+        }
+
+        /**
+        * Inserts the string without copying it, the memory must outlive the broker, see fsid_insert_external.
+        * @return Non-negative value associated with this string, otherwise negative result code.
+        */
+        int insert_external(std::string_view _string)
+        {
+            detail::unique_guard<Lock> guard(locks.lock());
+            return fsid_insert_external(handle, detail::data(_string), _string.size());
+        }
+
+        /**
+        * Removes the string associated with the value, the value is reused by later inserts, see fsid_remove_value.
+        * @return FSID_SUCCESSFUL if successful, FSID_ERR_INVALID_VALUE if _value is not associated with a string.
+        */
+        int remove(int _value)
+        {
+            detail::unique_guard<Lock> guard(locks.lock());
+            return fsid_remove_value(handle, _value);
+        }
+
+        /**
+        * Checks an array of strings under a single lock, see fsid_check_batch.
+        */
+        int check_batch(const char* const* _strings, const std::size_t* _lengths, std::size_t _count, int* _values) const
+        {
+            detail::shared_guard<Lock> guard(locks.lock());
+            return fsid_check_batch(handle, _strings, _lengths, _count, _values);
+        }
+
+        /**
+        * Inserts an array of strings under a single lock, see fsid_insert_batch.
+        */
+        int insert_batch(const char* const* _strings, const std::size_t* _lengths, std::size_t _count, int* _values)
+        {
+            detail::unique_guard<Lock> guard(locks.lock());
+            return fsid_insert_batch(handle, _strings, _lengths, _count, _values);
+        }
+
+        /**
+        * Preallocates storage for strings about to be inserted, see fsid_reserve.
+        */
+        int reserve(std::size_t _expectedStrings, std::size_t _expectedBytes = 0)
+        {
+            detail::unique_guard<Lock> guard(locks.lock());
+            return fsid_reserve(handle, _expectedStrings, _expectedBytes);
+        }
+
+        /**
+        * Rebuilds the index into contiguous memory, see fsid_compact.
+        */
+        int compact()
+        {
+            detail::unique_guard<Lock> guard(locks.lock());
+            return fsid_compact(handle);
+        }
+
+        /**
+        * Inserts all strings of another broker, see fsid_merge.
+        * @param _source Broker to take the strings from, locked shared meanwhile.
+        * @param _remap Array to receive the value in this broker at the index of each source value, can be nullptr.
+        * @param _remapSize Number of integers in _remap.
+        */
+        int merge(const broker& _source, int* _remap = nullptr, std::size_t _remapSize = 0)
+        {
+            if (&_source == this)
+                return FSID_ERR_INVALID_PARAM;
+
+            detail::unique_guard<Lock> guard(locks.lock());
+            detail::shared_guard<Lock> sourceGuard(_source.locks.lock());
+            return fsid_merge(handle, _source.handle, _remap, _remapSize);
+        }
+
+        /**
+        * Checks if there is a string associated with the value.
+        * @param _value Value.
+        * @param _string Pointer to receive the string, can be nullptr.
+        * @return FSID_SUCCESSFUL if successful, FSID_ERR_INVALID_VALUE if _value is not associated with a string.
+        */
+        int check_value(int _value, std::string_view* _string) const
+        {
+            detail::shared_guard<Lock> guard(locks.lock());
+            const char* pointer = nullptr;
+            std::size_t length = 0;
+            const int result = fsid_check_value(handle, _value, &pointer, &length);
+
+            if (result == FSID_SUCCESSFUL && _string)
+                *_string = std::string_view(pointer, length);
+
+            return result;
+        }
+
+        /**
+        * Visits all strings in value order, see fsid_foreach.
+        * @param _visit Callable taking value and std::string_view of each string, returns 0 to continue.
+        * @return FSID_SUCCESSFUL if all strings are visited, otherwise the value returned by _visit to stop.
+        */
+        template <class Visit>
+        int for_each(Visit&& _visit) const
+        {
+            detail::shared_guard<Lock> guard(locks.lock());
+            return fsid_foreach(handle, &visit_callback<typename std::remove_reference<Visit>::type>, const_cast<void*>(static_cast<const void*>(&_visit)));
+        }
+
+        /**
+        * Computes the hash used by the broker for the string.
+        */
+        std::uint64_t hash(std::string_view _string) const
+        {
+            if constexpr (!std::is_same<Hash, default_hash>::value)
+            {
+                if (!frozen)
+                    return Hash()(_string);
+            }
+
+            return fsid_hash_stringlen(handle, detail::data(_string), _string.size());
+        }
+
+        /**
+        * Writes a snapshot image of the broker to the file, see fsid_save_file.
+        */
+        int save_file(const char* _path) const
+        {
+            detail::shared_guard<Lock> guard(locks.lock());
+            return fsid_save_file(handle, _path);
+        }
+
+        /**
+        * Writes a frozen image of the broker to the file, see fsid_freeze_file.
+        */
+        int freeze_file(const char* _path) const
+        {
+            detail::shared_guard<Lock> guard(locks.lock());
+            return fsid_freeze_file(handle, _path);
+        }
+
+#ifdef FSID_STATISTICS
+        /**
+        * Get the broker statistics, see fsid_get_statistics.
+        */
+        int statistics(fsid_statistics_t* _stat) const
+        {
+            detail::shared_guard<Lock> guard(locks.lock());
+            return fsid_get_statistics(_stat, handle);
+        }
+#endif /* FSID_STATISTICS */
+
+        /**
+        * Underlying broker for C calls, the caller takes the locks of the Lock policy itself.
+        */
+        fsid_handle_t get() const noexcept { return handle; }
+
+    private:
+        explicit broker(fsid_handle_t _handle) noexcept : handle(_handle) {}
+
+        static void check_result(int _result)
+        {
+            if (_result != FSID_SUCCESSFUL)
+                throw error(_result);
+        }
+
+        static std::uint64_t FSID_CALLBACK hash_callback(void*, const char* _string, std::size_t _length)
+        {
+            return Hash()(std::string_view(_string, _length));
+        }
+
+        template <class Visit>
+        static int FSID_CALLBACK visit_callback(void* _userData, int _value, const char* _string, std::size_t _length)
+        {
+            return (*static_cast<Visit*>(_userData))(_value, std::string_view(_string, _length));
+        }
+
+        static void* FSID_CALLBACK alloc_callback(void*, std::size_t _size)
+        {
+            return Alloc().allocate(_size);
+        }
+
+        static void FSID_CALLBACK free_callback(void*, void* _pointer)
+        {
+            Alloc().deallocate(_pointer);
+        }
+
+        static fsid_init_t prepare(const fsid_init_t& _params) noexcept
+        {
+            fsid_init_t params = _params;
+
+            params.allocFunc = nullptr;
+            params.freeFunc = nullptr;
+            params.hashFunc = nullptr;
+            params.hash64Func = nullptr;
+            params.rolockFunc = nullptr;
+            params.rounlockFunc = nullptr;
+            params.rwlockFunc = nullptr;
+            params.rwunlockFunc = nullptr;
+            params.flags |= FSID_FLAG_EXTERNAL_LOCKING;
+
+            if constexpr (!std::is_same<Hash, default_hash>::value)
+                params.hash64Func = &hash_callback;
+
+            if constexpr (!std::is_same<Alloc, default_alloc>::value)
+            {
+                params.allocFunc = &alloc_callback;
+                params.freeFunc = &free_callback;
+            }
+
+            return params;
+        }
+
+        fsid_handle_t handle = nullptr;
+        bool frozen = false; /* Frozen images are hashed by the library with their own hash function */
+        std::uint32_t shardBits = 0;
+        detail::lock_holder<Lock> locks;
+    };
+} /* namespace fsid */
+
+/**
+* Compile-time value of a string in a broker seeded with the dictionary, a string not in the dictionary is a compile error.
+*/
+#define FSID_ID_OF(_dictionary, _string) (std::integral_constant<int, (_dictionary).id(_string)>::value)
+
+/**
+* Compile-time value of a string in the dictionary named by FSID_DICTIONARY, fsid_dictionary by default.
+*/
+#ifndef FSID_DICTIONARY
+#define FSID_DICTIONARY fsid_dictionary
+#endif
+
+#define FSID_ID(_string) FSID_ID_OF(FSID_DICTIONARY, _string)
+
+#endif /* FSID_HPP_INCLUDE */